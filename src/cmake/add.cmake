@@ -85,6 +85,7 @@ function(__cxxpm_install cxxpm name version configuration)
     "--build-type=${configuration}"
     "--install=${PACKAGE_SPEC}"
     "--export-cmake=${CMAKE_CURRENT_BINARY_DIR}/${name}.cmake"
+    "--lock=${CMAKE_CURRENT_BINARY_DIR}/${name}.cxxpm-lock"
     RESULT_VARIABLE EXIT_CODE
     COMMAND_ECHO STDOUT)
 
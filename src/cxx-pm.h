@@ -2,8 +2,20 @@
 
 #include <filesystem>
 
+// Check of already installed package files
+enum class EVerifyMode {
+  Fast,
+  Sampled,
+  Full
+};
+
 struct CxxPmSettings {
   std::filesystem::path PackageRoot;
   std::filesystem::path HomeDir;
   std::filesystem::path DistrDir;
+  EVerifyMode VerifyMode = EVerifyMode::Sampled;
+  // Write text manifest.txt in addition to binary manifest
+  bool TextManifest = false;
+  // Threads for hashing archive and installed files of one package, cores are shared by concurrently installed packages
+  unsigned HashThreads = 1;
 };
@@ -3,6 +3,8 @@
 #include <string.h>
 
 #ifndef WIN32
+#include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <sys/wait.h>
 extern char** environ;
@@ -12,6 +14,58 @@ extern char** environ;
 
 #include <mutex>
 
+#ifndef WIN32
+bool pipeCloseOnExec(int fds[2])
+{
+#ifdef __linux__
+  return pipe2(fds, O_CLOEXEC) == 0;
+#else
+  // No pipe2: small window in which concurrent fork can inherit descriptors
+  if (pipe(fds) != 0)
+    return false;
+  fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+  fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+  return true;
+#endif
+}
+
+// Forked by multithreaded process: only async-signal-safe functions can be used until exec
+static void childWrite(const char *s)
+{
+  size_t size = strlen(s);
+  while (size) {
+    ssize_t written = write(STDERR_FILENO, s, size);
+    if (written <= 0)
+      return;
+    s += written;
+    size -= written;
+  }
+}
+
+[[noreturn]] static void childFail(const char *operation, int error, char *const *cmdLine)
+{
+  char errorText[16];
+  char *p = errorText + sizeof(errorText);
+  *--p = 0;
+  do {
+    *--p = '0' + error % 10;
+    error /= 10;
+  } while (error);
+
+  childWrite(operation);
+  childWrite(" ERROR errno=");
+  childWrite(p);
+  childWrite(": \"");
+  for (char *const *arg = cmdLine; *arg; arg++) {
+    if (arg != cmdLine)
+      childWrite(" ");
+    childWrite(*arg);
+  }
+  childWrite("\"\n");
+  _exit(1);
+}
+#endif
+
 #ifdef WIN32
 struct JobSingletone {
 public:
@@ -90,6 +144,11 @@ void updatePath()
   gPathCache.update();
 }
 
+std::filesystem::path executablePath(const std::filesystem::path &path)
+{
+  return path.is_absolute() ? path : gPathCache.get(path);
+}
+
 static void doPrintCommand(const std::filesystem::path &path, const std::vector<std::string> &arguments)
 {
   printf("+ %s", path.string().c_str());
@@ -223,13 +282,21 @@ bool run(const std::filesystem::path &workingDirectory,
 
   int stdoutPipe[2];
   int stderrPipe[2];
-  if (pipe(stdoutPipe) == -1)
+  if (!pipeCloseOnExec(stdoutPipe))
     return false;
-  if (pipe(stderrPipe) == -1)
+  if (!pipeCloseOnExec(stderrPipe)) {
+    close(stdoutPipe[0]);
+    close(stdoutPipe[1]);
     return false;
+  }
   pid_t pid = fork();
-  if (pid == -1)
+  if (pid == -1) {
+    close(stdoutPipe[0]);
+    close(stdoutPipe[1]);
+    close(stderrPipe[0]);
+    close(stderrPipe[1]);
     return false;
+  }
   if (pid == 0) {
     dup2(stdoutPipe[1], STDOUT_FILENO);
     dup2(stderrPipe[1], STDERR_FILENO);
@@ -237,21 +304,11 @@ bool run(const std::filesystem::path &workingDirectory,
     close(stdoutPipe[1]);
     close(stderrPipe[0]);
     close(stderrPipe[1]);
-    if (chdir(workingDirectory.c_str()) == -1) {
-      fprintf(stderr, "chdir ERROR %s: \"", strerror(errno));
-      exit(1);
-    }
+    if (chdir(workingDirectory.c_str()) == -1)
+      childFail("chdir", errno, &cmdLine[0]);
 
-    if (execve(fullPath.c_str(), &cmdLine[0], &env[0]) == -1) {
-      fprintf(stderr, "execv ERROR %s: \"", strerror(errno));
-      for (size_t i = 0, ie = cmdLine.size() - 1; i != ie; ++i) {
-        fprintf(stderr, i != (ie-1) ? "%s " : "%s", cmdLine[i]);
-      }
-      fprintf(stderr, "\"\n");
-      exit(1);
-    } else {
-      exit(0);
-    }
+    execve(fullPath.c_str(), &cmdLine[0], &env[0]);
+    childFail("execv", errno, &cmdLine[0]);
   } else {
     close(stdoutPipe[1]);
     close(stderrPipe[1]);
@@ -378,30 +435,23 @@ bool runCaptureLog(const std::filesystem::path &workingDirectory, const std::fil
   env.push_back(0);
 
   int logPipe[2];
-  if (pipe(logPipe) == -1)
+  if (!pipeCloseOnExec(logPipe))
     return false;
   pid_t pid = fork();
-  if (pid == -1)
+  if (pid == -1) {
+    close(logPipe[0]);
+    close(logPipe[1]);
     return false;
+  }
   if (pid == 0) {
     dup2(logPipe[1], STDOUT_FILENO);
     dup2(logPipe[1], STDERR_FILENO);
     close(logPipe[0]);
     close(logPipe[1]);
-    if (chdir(workingDirectory.c_str()) == -1) {
-      fprintf(stderr, "chdir ERROR %s: \"", strerror(errno));
-      exit(1);
-    }
-    if (execve(fullPath.c_str(), &cmdLine[0], &env[0]) == -1) {
-      fprintf(stderr, "execv ERROR %s: \"", strerror(errno));
-      for (size_t i = 0, ie = cmdLine.size() - 1; i != ie; ++i) {
-        fprintf(stderr, i != (ie-1) ? "%s " : "%s", cmdLine[i]);
-      }
-      fprintf(stderr, "\"\n");
-      exit(1);
-    } else {
-      exit(0);
-    }
+    if (chdir(workingDirectory.c_str()) == -1)
+      childFail("chdir", errno, &cmdLine[0]);
+    execve(fullPath.c_str(), &cmdLine[0], &env[0]);
+    childFail("execv", errno, &cmdLine[0]);
   } else {
     close(logPipe[1]);
     ssize_t bytesRead = 0;
@@ -511,20 +561,10 @@ bool runNoCapture(const std::filesystem::path &workingDirectory, const std::file
   if (pid == -1)
     return false;
   if (pid == 0) {
-    if (chdir(workingDirectory.c_str()) == -1) {
-      fprintf(stderr, "chdir ERROR %s: \"", strerror(errno));
-      exit(1);
-    }
-    if (execve(fullPath.c_str(), &cmdLine[0], &env[0]) == -1) {
-      fprintf(stderr, "execv ERROR %s: \"", strerror(errno));
-      for (size_t i = 0, ie = cmdLine.size() - 1; i != ie; ++i) {
-        fprintf(stderr, i != (ie-1) ? "%s " : "%s", cmdLine[i]);
-      }
-      fprintf(stderr, "\"\n");
-      exit(1);
-    } else {
-      exit(0);
-    }
+    if (chdir(workingDirectory.c_str()) == -1)
+      childFail("chdir", errno, &cmdLine[0]);
+    execve(fullPath.c_str(), &cmdLine[0], &env[0]);
+    childFail("execv", errno, &cmdLine[0]);
   } else {
     int exitCode;
     do {
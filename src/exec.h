@@ -18,6 +18,8 @@ private:
 };
 
 void updatePath();
+// Full path of executable as it would be started by run functions
+std::filesystem::path executablePath(const std::filesystem::path &path);
 
 bool run(const std::filesystem::path &workingDirectory,
 	     const std::filesystem::path &path,
@@ -45,4 +47,7 @@ bool runNoCapture(const std::filesystem::path &workingDirectory,
 
 #ifdef WIN32
 void terminateAllChildProcess();
+#else
+// pipe() with close-on-exec descriptors: processes forked by other threads at same time don't inherit them
+bool pipeCloseOnExec(int fds[2]);
 #endif
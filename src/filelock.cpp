@@ -0,0 +1,90 @@
+#include "filelock.h"
+
+#ifdef WIN32
+#include <Windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+bool FileLock::lock(const std::filesystem::path &path, bool *waited)
+{
+  unlock();
+  if (waited)
+    *waited = false;
+
+  std::error_code ec;
+  std::filesystem::create_directories(path.parent_path(), ec);
+
+#ifdef WIN32
+  HANDLE handle = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (handle == INVALID_HANDLE_VALUE) {
+    fprintf(stderr, "ERROR: can't open lock file %s\n", path.string().c_str());
+    return false;
+  }
+
+  OVERLAPPED overlapped = {};
+  if (!LockFileEx(handle, LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY, 0, 1, 0, &overlapped)) {
+    if (waited)
+      *waited = true;
+    if (!LockFileEx(handle, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &overlapped)) {
+      fprintf(stderr, "ERROR: can't lock file %s\n", path.string().c_str());
+      CloseHandle(handle);
+      return false;
+    }
+  }
+
+  Handle_ = handle;
+#else
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd == -1) {
+    fprintf(stderr, "ERROR: can't open lock file %s\n", path.c_str());
+    return false;
+  }
+
+  // flock (unlike fcntl locks) is bound to open file description, so it works between threads too
+  if (flock(fd, LOCK_EX | LOCK_NB) == -1) {
+    if (waited)
+      *waited = true;
+    int result;
+    while ((result = flock(fd, LOCK_EX)) == -1 && errno == EINTR)
+      continue;
+    if (result == -1) {
+      fprintf(stderr, "ERROR: can't lock file %s\n", path.c_str());
+      close(fd);
+      return false;
+    }
+  }
+
+  Fd_ = fd;
+#endif
+
+  return true;
+}
+
+void FileLock::unlock()
+{
+#ifdef WIN32
+  if (Handle_) {
+    OVERLAPPED overlapped = {};
+    UnlockFileEx(Handle_, 0, 1, 0, &overlapped);
+    CloseHandle(Handle_);
+    Handle_ = nullptr;
+  }
+#else
+  if (Fd_ != -1) {
+    flock(Fd_, LOCK_UN);
+    close(Fd_);
+    Fd_ = -1;
+  }
+#endif
+}
+
+std::filesystem::path lockPathFor(const std::filesystem::path &path)
+{
+  std::filesystem::path result = path;
+  result += ".lock";
+  return result;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <filesystem>
+
+// Advisory inter-process lock, held while object alive
+// Lock files are never deleted: removing them would allow two processes lock different inodes
+class FileLock {
+public:
+  FileLock() {}
+  ~FileLock() { unlock(); }
+  FileLock(const FileLock&) = delete;
+  FileLock &operator=(const FileLock&) = delete;
+
+  // Blocks until lock acquired; 'waited' set to true if lock was held by someone else
+  bool lock(const std::filesystem::path &path, bool *waited = nullptr);
+  void unlock();
+
+private:
+#ifdef WIN32
+  void *Handle_ = nullptr;
+#else
+  int Fd_ = -1;
+#endif
+};
+
+// Lock file path for directory or file which can be removed and recreated while locked
+std::filesystem::path lockPathFor(const std::filesystem::path &path);
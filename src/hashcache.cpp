@@ -0,0 +1,177 @@
+#include "hashcache.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#ifdef WIN32
+#include <Windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+static std::filesystem::path gCacheDirectory;
+static bool gCacheLookup = true;
+
+// Files changed less than this time ago are not cached: next change can keep same mtime and ctime
+static constexpr int64_t RacyInterval = 2000000000;
+
+struct CFileIdentity {
+  uint64_t Device = 0;
+  uint64_t Inode = 0;
+  uint64_t Size = 0;
+  // Nanoseconds since epoch
+  int64_t MTime = 0;
+  int64_t CTime = 0;
+};
+
+#ifdef WIN32
+static int64_t fileTimeToUnixNs(uint64_t fileTime)
+{
+  // FILETIME: 100ns intervals since 1601-01-01
+  return (static_cast<int64_t>(fileTime) - 116444736000000000LL) * 100;
+}
+#endif
+
+static bool fileIdentity(const std::filesystem::path &path, CFileIdentity &identity)
+{
+#ifdef WIN32
+  HANDLE handle = CreateFileW(path.c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, 0, nullptr);
+  if (handle == INVALID_HANDLE_VALUE)
+    return false;
+  BY_HANDLE_FILE_INFORMATION info;
+  FILE_BASIC_INFO basic;
+  bool result = GetFileInformationByHandle(handle, &info) &&
+                GetFileInformationByHandleEx(handle, FileBasicInfo, &basic, sizeof(basic));
+  CloseHandle(handle);
+  if (!result)
+    return false;
+  identity.Device = info.dwVolumeSerialNumber;
+  identity.Inode = (static_cast<uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+  identity.Size = (static_cast<uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+  identity.MTime = fileTimeToUnixNs(basic.LastWriteTime.QuadPart);
+  identity.CTime = fileTimeToUnixNs(basic.ChangeTime.QuadPart);
+#else
+  struct stat st;
+  if (::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+    return false;
+  identity.Device = st.st_dev;
+  identity.Inode = st.st_ino;
+  identity.Size = st.st_size;
+#ifdef __APPLE__
+  identity.MTime = static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+  identity.CTime = static_cast<int64_t>(st.st_ctimespec.tv_sec) * 1000000000 + st.st_ctimespec.tv_nsec;
+#else
+  identity.MTime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+  identity.CTime = static_cast<int64_t>(st.st_ctim.tv_sec) * 1000000000 + st.st_ctim.tv_nsec;
+#endif
+#endif
+  return true;
+}
+
+static std::filesystem::path cacheEntryPath(const CFileIdentity &identity, const char *algorithm)
+{
+  char name[64];
+  snprintf(name, sizeof(name), "%" PRIx64 "-%" PRIx64 ".%s", identity.Device, identity.Inode, algorithm);
+  return gCacheDirectory / name;
+}
+
+static bool cacheLoad(const CFileIdentity &identity, const char *algorithm, std::string &hash)
+{
+  FILE *hFile = fopen(cacheEntryPath(identity, algorithm).string().c_str(), "rb");
+  if (!hFile)
+    return false;
+
+  uint64_t size;
+  int64_t mtime;
+  int64_t ctime;
+  char hex[129];
+  int fields = fscanf(hFile, "%" SCNu64 " %" SCNd64 " %" SCNd64 " %128s", &size, &mtime, &ctime, hex);
+  fclose(hFile);
+  if (fields != 4 || size != identity.Size || mtime != identity.MTime || ctime != identity.CTime)
+    return false;
+
+  hash = hex;
+  return true;
+}
+
+static void cacheStore(const CFileIdentity &identity, const char *algorithm, const std::string &hash)
+{
+  int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+  if (now - std::max(identity.MTime, identity.CTime) < RacyInterval)
+    return;
+
+  // Write to temporary file and rename: other cxx-pm processes can read this entry right now
+  std::filesystem::path entryPath = cacheEntryPath(identity, algorithm);
+  std::filesystem::path tmpPath = entryPath;
+  tmpPath += "." + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) +
+             "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+  FILE *hFile = fopen(tmpPath.string().c_str(), "wb");
+  if (!hFile)
+    return;
+  bool success = fprintf(hFile, "%" PRIu64 " %" PRId64 " %" PRId64 " %s\n", identity.Size, identity.MTime, identity.CTime, hash.c_str()) > 0;
+  success &= fclose(hFile) == 0;
+
+  std::error_code ec;
+  if (success)
+    std::filesystem::rename(tmpPath, entryPath, ec);
+  if (!success || ec)
+    std::filesystem::remove(tmpPath, ec);
+}
+
+void hashCacheSetDirectory(const std::filesystem::path &directory, bool lookup)
+{
+  std::error_code ec;
+  std::filesystem::create_directories(directory, ec);
+  gCacheDirectory = directory;
+  gCacheLookup = lookup;
+}
+
+size_t hashCachePrune(const std::filesystem::path &directory, std::chrono::hours maxAge)
+{
+  // Hits don't refresh entries, so entry of file still in use is recomputed once per 'maxAge'
+  size_t removed = 0;
+  std::error_code ec;
+  auto now = std::filesystem::file_time_type::clock::now();
+  for (std::filesystem::directory_iterator I(directory, ec), IE; !ec && I != IE; I.increment(ec)) {
+    std::error_code entryEc;
+    if (!I->is_regular_file(entryEc))
+      continue;
+    auto writeTime = I->last_write_time(entryEc);
+    if (entryEc || now - writeTime < maxAge)
+      continue;
+    if (std::filesystem::remove(I->path(), entryEc))
+      removed++;
+  }
+
+  return removed;
+}
+
+std::string hashCacheFileHash(const std::filesystem::path &path,
+                              const char *algorithm,
+                              const std::function<std::string(const std::filesystem::path&)> &hash)
+{
+  CFileIdentity identity;
+  if (gCacheDirectory.empty() || !fileIdentity(path, identity))
+    return hash(path);
+
+  std::string result;
+  if (gCacheLookup && cacheLoad(identity, algorithm, result))
+    return result;
+
+  result = hash(path);
+  if (result.empty())
+    return result;
+
+  // File changed while hashed: result can't be bound to identity taken before
+  CFileIdentity after;
+  if (fileIdentity(path, after) &&
+      after.Device == identity.Device &&
+      after.Inode == identity.Inode &&
+      after.Size == identity.Size &&
+      after.MTime == identity.MTime &&
+      after.CTime == identity.CTime)
+    cacheStore(identity, algorithm, result);
+  return result;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <string>
+
+// Persistent cache of file content hashes, keyed by device, inode, size, mtime and ctime
+// One entry per file and algorithm: <directory>/<device>-<inode>.<algorithm>, content "<size> <mtime> <ctime> <hash>"
+// Cache is disabled until directory is set; with lookup disabled hashes are always computed, but entries are updated
+
+void hashCacheSetDirectory(const std::filesystem::path &directory, bool lookup);
+
+// Returns cached hash if file identity not changed, otherwise computes it by 'hash' and stores result
+std::string hashCacheFileHash(const std::filesystem::path &path,
+                              const char *algorithm,
+                              const std::function<std::string(const std::filesystem::path&)> &hash);
+
+// Removes entries written more than 'maxAge' ago (entries of deleted files are never read again)
+// Returns number of removed entries
+size_t hashCachePrune(const std::filesystem::path &directory, std::chrono::hours maxAge);
@@ -1,5 +1,90 @@
 #include "httpdownload.h"
+#include "cxx-pm-config.h"
+#include "exec.h"
+#include "mappedfile.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Byte range request, used by resumable downloads
+struct CHttpRange {
+  // Bytes [Begin, End); End == 0: up to end of resource
+  uint64_t Begin = 0;
+  uint64_t End = 0;
+  // If-Range validator: ETag or Last-Modified of data received before
+  std::string IfRange;
+
+  bool empty() const { return Begin == 0 && End == 0; }
+};
+
+// Response data known before body arrives
+struct CHttpResponseInfo {
+  unsigned Status = 0;
+  std::string ContentLength;
+  std::string ContentRange;
+  std::string AcceptRanges;
+  std::string ETag;
+  std::string LastModified;
+  // Filled by checkResponse: size of whole resource (0 if unknown) and its offset of first body byte
+  uint64_t TotalSize = 0;
+  uint64_t Offset = 0;
+};
+
+// Called after response headers, before body; return false to abort download
+using HttpResponseHandler = std::function<bool(const CHttpResponseInfo &info)>;
+
+static std::string rangeHeaders(const CHttpRange &range)
+{
+  if (range.empty())
+    return std::string();
+  std::string headers = "Range: bytes=" + std::to_string(range.Begin) + "-" + (range.End ? std::to_string(range.End - 1) : std::string()) + "\r\n";
+  if (!range.IfRange.empty())
+    headers += "If-Range: " + range.IfRange + "\r\n";
+  return headers;
+}
+
+// Accepts full response or partial one starting at requested offset
+// 416 (range not satisfiable) returned to caller without error message
+static bool checkResponse(const std::string &url, const CHttpRange &range, CHttpResponseInfo &info)
+{
+  if (info.Status == 200) {
+    info.Offset = 0;
+    info.TotalSize = strtoull(info.ContentLength.c_str(), nullptr, 10);
+    return true;
+  }
+
+  if (info.Status == 206 && !range.empty()) {
+    // bytes <first>-<last>/<total or *>
+    unsigned long long first = 0;
+    unsigned long long last = 0;
+    if (sscanf(info.ContentRange.c_str(), "bytes %llu-%llu", &first, &last) != 2 || first != range.Begin) {
+      fprintf(stderr, "ERROR: invalid Content-Range '%s' for %s\n", info.ContentRange.c_str(), url.c_str());
+      return false;
+    }
+    const char *total = strchr(info.ContentRange.c_str(), '/');
+    info.Offset = first;
+    info.TotalSize = total ? strtoull(total + 1, nullptr, 10) : 0;
+    return true;
+  }
+
+  if (info.Status != 416)
+    fprintf(stderr, "ERROR: HTTP %u for %s\n", info.Status, url.c_str());
+  return false;
+}
+
+// 416 passed to handler too, so it can restart download from beginning
+static bool acceptResponse(const std::string &url, const CHttpRange &range, CHttpResponseInfo &info, const HttpResponseHandler &onResponse)
+{
+  bool valid = checkResponse(url, range, info);
+  if (!valid && info.Status != 416)
+    return false;
+  return (!onResponse || onResponse(info)) && valid;
+}
 
 #ifdef WIN32
 
@@ -47,7 +132,29 @@ static bool parseUrl(const std::string &url, UrlComponents &out)
   return true;
 }
 
-static bool httpDownloadImpl(const std::string &url, std::vector<uint8_t> &data)
+static bool queryHeader(HINTERNET hRequest, DWORD header, std::string &value)
+{
+  wchar_t buffer[1024];
+  DWORD size = sizeof(buffer);
+  if (!WinHttpQueryHeaders(hRequest, header, WINHTTP_HEADER_NAME_BY_INDEX, buffer, &size, WINHTTP_NO_HEADER_INDEX))
+    return false;
+  // Header values are ASCII
+  value.clear();
+  for (DWORD i = 0; i < size / sizeof(wchar_t); i++)
+    value.push_back(static_cast<char>(buffer[i]));
+  return true;
+}
+
+static HINTERNET openSession()
+{
+  return WinHttpOpen(L"cxx-pm/1.0",
+                     WINHTTP_ACCESS_TYPE_DEFAULT_PROXY,
+                     WINHTTP_NO_PROXY_NAME,
+                     WINHTTP_NO_PROXY_BYPASS, 0);
+}
+
+// WinHTTP keeps connections of session alive, client's session shared between requests
+static bool httpRequestImpl(HttpClient *client, const std::string &url, const CHttpRange &range, const HttpResponseHandler &onResponse, const HttpSink &sink)
 {
   UrlComponents uc;
   if (!parseUrl(url, uc)) {
@@ -55,10 +162,8 @@ static bool httpDownloadImpl(const std::string &url, std::vector<uint8_t> &data)
     return false;
   }
 
-  HINTERNET hSession = WinHttpOpen(L"cxx-pm/1.0",
-                                    WINHTTP_ACCESS_TYPE_DEFAULT_PROXY,
-                                    WINHTTP_NO_PROXY_NAME,
-                                    WINHTTP_NO_PROXY_BYPASS, 0);
+  HINTERNET ownSession = client ? nullptr : openSession();
+  HINTERNET hSession = client ? static_cast<HINTERNET>(client->session()) : ownSession;
   if (!hSession) {
     fprintf(stderr, "ERROR: WinHttpOpen failed\n");
     return false;
@@ -67,7 +172,8 @@ static bool httpDownloadImpl(const std::string &url, std::vector<uint8_t> &data)
   HINTERNET hConnect = WinHttpConnect(hSession, uc.host.c_str(), uc.port, 0);
   if (!hConnect) {
     fprintf(stderr, "ERROR: WinHttpConnect failed\n");
-    WinHttpCloseHandle(hSession);
+    if (ownSession)
+      WinHttpCloseHandle(ownSession);
     return false;
   }
 
@@ -78,16 +184,19 @@ static bool httpDownloadImpl(const std::string &url, std::vector<uint8_t> &data)
   if (!hRequest) {
     fprintf(stderr, "ERROR: WinHttpOpenRequest failed\n");
     WinHttpCloseHandle(hConnect);
-    WinHttpCloseHandle(hSession);
+    if (ownSession)
+      WinHttpCloseHandle(ownSession);
     return false;
   }
 
-  if (!WinHttpSendRequest(hRequest, WINHTTP_NO_ADDITIONAL_HEADERS, 0,
+  std::wstring headers = utf8ToWide(rangeHeaders(range));
+  if (!WinHttpSendRequest(hRequest, headers.empty() ? WINHTTP_NO_ADDITIONAL_HEADERS : headers.c_str(), headers.empty() ? 0 : static_cast<DWORD>(-1L),
                            WINHTTP_NO_REQUEST_DATA, 0, 0, 0)) {
     fprintf(stderr, "ERROR: WinHttpSendRequest failed\n");
     WinHttpCloseHandle(hRequest);
     WinHttpCloseHandle(hConnect);
-    WinHttpCloseHandle(hSession);
+    if (ownSession)
+      WinHttpCloseHandle(ownSession);
     return false;
   }
 
@@ -95,99 +204,1159 @@ static bool httpDownloadImpl(const std::string &url, std::vector<uint8_t> &data)
     fprintf(stderr, "ERROR: WinHttpReceiveResponse failed\n");
     WinHttpCloseHandle(hRequest);
     WinHttpCloseHandle(hConnect);
-    WinHttpCloseHandle(hSession);
+    if (ownSession)
+      WinHttpCloseHandle(ownSession);
     return false;
   }
 
-  // Check status code
+  // Check status code and headers
   DWORD statusCode = 0;
   DWORD statusCodeSize = sizeof(statusCode);
   WinHttpQueryHeaders(hRequest, WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER,
                        WINHTTP_HEADER_NAME_BY_INDEX, &statusCode, &statusCodeSize,
                        WINHTTP_NO_HEADER_INDEX);
-  if (statusCode != 200) {
-    fprintf(stderr, "ERROR: HTTP %lu for %s\n", statusCode, url.c_str());
+  CHttpResponseInfo info;
+  info.Status = statusCode;
+  queryHeader(hRequest, WINHTTP_QUERY_CONTENT_LENGTH, info.ContentLength);
+  queryHeader(hRequest, WINHTTP_QUERY_CONTENT_RANGE, info.ContentRange);
+  queryHeader(hRequest, WINHTTP_QUERY_ACCEPT_RANGES, info.AcceptRanges);
+  queryHeader(hRequest, WINHTTP_QUERY_ETAG, info.ETag);
+  queryHeader(hRequest, WINHTTP_QUERY_LAST_MODIFIED, info.LastModified);
+  if (!acceptResponse(url, range, info, onResponse)) {
     WinHttpCloseHandle(hRequest);
     WinHttpCloseHandle(hConnect);
-    WinHttpCloseHandle(hSession);
+    if (ownSession)
+      WinHttpCloseHandle(ownSession);
     return false;
   }
 
   // Read data
   uint8_t buffer[65536];
   DWORD bytesRead = 0;
+  bool success = false;
   while (WinHttpReadData(hRequest, buffer, sizeof(buffer), &bytesRead)) {
-    if (bytesRead == 0)
+    if (bytesRead == 0) {
+      success = true;
+      break;
+    }
+    if (!sink(buffer, bytesRead))
       break;
-    data.insert(data.end(), buffer, buffer + bytesRead);
   }
 
   WinHttpCloseHandle(hRequest);
   WinHttpCloseHandle(hConnect);
-  WinHttpCloseHandle(hSession);
-  return true;
+  if (ownSession)
+    WinHttpCloseHandle(ownSession);
+  return success;
+}
+
+HttpClient::HttpClient() : Session_(openSession()) {}
+
+HttpClient::~HttpClient()
+{
+  if (Session_)
+    WinHttpCloseHandle(static_cast<HINTERNET>(Session_));
 }
 
 #else
 
-// On Linux/macOS, use wget (already installed)
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
 #include <unistd.h>
+#include <algorithm>
+#include <map>
+#include <memory>
+#ifdef CXXPM_HAVE_OPENSSL
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+#endif
+
+static constexpr size_t ReceiveBufferSize = 1u << 16;
+static constexpr unsigned MaxRedirects = 10;
+static constexpr size_t MaxIdleConnections = 32;
+static constexpr int SocketTimeoutSeconds = 60;
+
+struct CUrl {
+  bool Https = false;
+  std::string Scheme;
+  // host[:port], value of Host header
+  std::string Authority;
+  std::string Host;
+  std::string Port;
+  // Path and query
+  std::string Target;
+};
 
-static bool httpDownloadImpl(const std::string &url, std::vector<uint8_t> &data)
+static std::string toLower(std::string s)
 {
-  // Download to unique temp file, then read
-  char tmpPath[] = "/tmp/cxxpm-dl-XXXXXX";
-  int fd = mkstemp(tmpPath);
-  if (fd < 0) {
-    fprintf(stderr, "ERROR: can't create temp file\n");
+  for (char &c : s)
+    c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+  return s;
+}
+
+static bool parseUrl(const std::string &url, CUrl &out)
+{
+  size_t schemeEnd = url.find("://");
+  if (schemeEnd == std::string::npos)
+    return false;
+  out.Scheme = toLower(url.substr(0, schemeEnd));
+  if (out.Scheme == "http")
+    out.Https = false;
+  else if (out.Scheme == "https")
+    out.Https = true;
+  else
     return false;
+
+  size_t authorityBegin = schemeEnd + 3;
+  size_t authorityEnd = url.find_first_of("/?#", authorityBegin);
+  if (authorityEnd == std::string::npos)
+    authorityEnd = url.size();
+  out.Authority = url.substr(authorityBegin, authorityEnd - authorityBegin);
+  if (out.Authority.empty() || out.Authority.find('@') != std::string::npos)
+    return false;
+
+  std::string port;
+  if (out.Authority[0] == '[') {
+    // IPv6 literal
+    size_t close = out.Authority.find(']');
+    if (close == std::string::npos)
+      return false;
+    out.Host = out.Authority.substr(1, close - 1);
+    port = out.Authority.substr(close + 1);
+  } else {
+    size_t colon = out.Authority.find(':');
+    out.Host = out.Authority.substr(0, colon);
+    port = colon != std::string::npos ? out.Authority.substr(colon) : std::string();
   }
-  close(fd);
+  if (out.Host.empty() || (!port.empty() && (port[0] != ':' || port.size() == 1)))
+    return false;
+  out.Port = !port.empty() ? port.substr(1) : out.Https ? "443" : "80";
 
-  std::string cmd = "wget -q \"" + url + "\" -O \"" + tmpPath + "\"";
-  if (system(cmd.c_str()) != 0) {
-    remove(tmpPath);
-    fprintf(stderr, "ERROR: wget failed for %s\n", url.c_str());
+  size_t fragment = url.find('#', authorityEnd);
+  out.Target = url.substr(authorityEnd, fragment == std::string::npos ? std::string::npos : fragment - authorityEnd);
+  if (out.Target.empty() || out.Target[0] != '/')
+    out.Target.insert(0, "/");
+  return true;
+}
+
+// Location header can be absolute or relative URL
+static std::string resolveLocation(const CUrl &base, const std::string &location)
+{
+  if (location.find("://") != std::string::npos)
+    return location;
+  if (location.compare(0, 2, "//") == 0)
+    return base.Scheme + ":" + location;
+  std::string prefix = base.Scheme + "://" + base.Authority;
+  if (!location.empty() && location[0] == '/')
+    return prefix + location;
+  std::string directory = base.Target.substr(0, base.Target.find('?'));
+  directory.erase(directory.rfind('/') + 1);
+
+  // Remove dot segments
+  std::string relative = location.substr(0, location.find('?'));
+  std::string query = relative.size() < location.size() ? location.substr(relative.size()) : std::string();
+  std::vector<std::string> segments;
+  size_t begin = 1;
+  std::string path = directory + relative;
+  while (begin <= path.size()) {
+    size_t end = path.find('/', begin);
+    if (end == std::string::npos)
+      end = path.size();
+    std::string segment = path.substr(begin, end - begin);
+    bool last = end == path.size();
+    if (segment == "..") {
+      if (!segments.empty())
+        segments.pop_back();
+      if (last)
+        segments.emplace_back();
+    } else if (segment == ".") {
+      if (last)
+        segments.emplace_back();
+    } else {
+      segments.push_back(segment);
+    }
+    begin = end + 1;
+  }
+
+  std::string target;
+  for (const auto &segment : segments)
+    target += "/" + segment;
+  return prefix + (target.empty() ? "/" : target) + query;
+}
+
+#ifndef __APPLE__
+// Peer can close connection while request is written: SIGPIPE blocked for this thread and discarded
+// (not ignored process-wide, child processes inherit ignored signals)
+class SigPipeGuard {
+public:
+  SigPipeGuard() {
+    sigemptyset(&Set_);
+    sigaddset(&Set_, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &Set_, &Old_);
+    sigset_t pending;
+    sigpending(&pending);
+    WasPending_ = sigismember(&pending, SIGPIPE);
+  }
+
+  ~SigPipeGuard() {
+    sigset_t pending;
+    sigpending(&pending);
+    if (!WasPending_ && sigismember(&pending, SIGPIPE)) {
+      struct timespec zero = {0, 0};
+      sigtimedwait(&Set_, nullptr, &zero);
+    }
+    pthread_sigmask(SIG_SETMASK, &Old_, nullptr);
+  }
+
+private:
+  sigset_t Set_;
+  sigset_t Old_;
+  bool WasPending_ = false;
+};
+#endif
+
+#ifdef CXXPM_HAVE_OPENSSL
+static SSL_CTX *tlsContext()
+{
+  static SSL_CTX *context = []() -> SSL_CTX* {
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    if (!ctx)
+      return nullptr;
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_default_verify_paths(ctx);
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, nullptr);
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+    // Many servers close connection without close_notify
+    SSL_CTX_set_options(ctx, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+    return ctx;
+  }();
+  return context;
+}
+#endif
+
+// Blocking connection with receive buffer
+class HttpConnection {
+public:
+  HttpConnection() : Buffer_(new uint8_t[ReceiveBufferSize]) {}
+  ~HttpConnection() { close(); }
+  HttpConnection(const HttpConnection&) = delete;
+  HttpConnection &operator=(const HttpConnection&) = delete;
+
+  bool connect(const CUrl &url);
+  void close();
+  bool write(const void *data, size_t size);
+
+  // Receive more data to buffer; returns false on error or if connection closed by peer (closed() is true)
+  bool fill();
+  bool closed() const { return Closed_; }
+  const uint8_t *data() const { return Buffer_.get() + Begin_; }
+  size_t available() const { return End_ - Begin_; }
+  void consume(size_t size) { Begin_ += size; }
+  // Line without CRLF
+  bool readLine(std::string &line);
+
+private:
+  int Fd_ = -1;
+#ifdef CXXPM_HAVE_OPENSSL
+  SSL *Ssl_ = nullptr;
+#endif
+  std::unique_ptr<uint8_t[]> Buffer_;
+  size_t Begin_ = 0;
+  size_t End_ = 0;
+  bool Closed_ = false;
+};
+
+bool HttpConnection::connect(const CUrl &url)
+{
+  close();
+
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo *addresses = nullptr;
+  int error = getaddrinfo(url.Host.c_str(), url.Port.c_str(), &hints, &addresses);
+  if (error != 0) {
+    fprintf(stderr, "ERROR: can't resolve %s: %s\n", url.Host.c_str(), gai_strerror(error));
     return false;
   }
 
-  FILE *f = fopen(tmpPath, "rb");
-  if (!f) {
-    remove(tmpPath);
-    fprintf(stderr, "ERROR: can't open downloaded file\n");
+  for (struct addrinfo *address = addresses; address; address = address->ai_next) {
+    int fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (fd == -1)
+      continue;
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    struct timeval timeout = {SocketTimeoutSeconds, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef __APPLE__
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+    if (::connect(fd, address->ai_addr, address->ai_addrlen) == 0) {
+      Fd_ = fd;
+      break;
+    }
+    ::close(fd);
+  }
+  freeaddrinfo(addresses);
+  if (Fd_ == -1) {
+    fprintf(stderr, "ERROR: can't connect to %s:%s\n", url.Host.c_str(), url.Port.c_str());
     return false;
   }
 
-  fseek(f, 0, SEEK_END);
-  long sz = ftell(f);
-  fseek(f, 0, SEEK_SET);
-  data.resize(sz);
-  fread(data.data(), 1, sz, f);
-  fclose(f);
-  remove(tmpPath);
+  if (url.Https) {
+#ifdef CXXPM_HAVE_OPENSSL
+    SSL_CTX *ctx = tlsContext();
+    Ssl_ = ctx ? SSL_new(ctx) : nullptr;
+    if (!Ssl_) {
+      fprintf(stderr, "ERROR: can't initialize TLS\n");
+      close();
+      return false;
+    }
+    SSL_set_fd(Ssl_, Fd_);
+    SSL_set_tlsext_host_name(Ssl_, url.Host.c_str());
+    X509_VERIFY_PARAM *param = SSL_get0_param(Ssl_);
+    if (X509_VERIFY_PARAM_set1_ip_asc(param, url.Host.c_str()) != 1)
+      SSL_set1_host(Ssl_, url.Host.c_str());
+
+    int result;
+    {
+#ifndef __APPLE__
+      SigPipeGuard guard;
+#endif
+      result = SSL_connect(Ssl_);
+    }
+    if (result != 1) {
+      unsigned long sslError = ERR_get_error();
+      fprintf(stderr, "ERROR: TLS handshake with %s failed: %s\n", url.Host.c_str(), sslError ? ERR_error_string(sslError, nullptr) : "connection closed");
+      ERR_clear_error();
+      close();
+      return false;
+    }
+#else
+    fprintf(stderr, "ERROR: built without TLS support\n");
+    close();
+    return false;
+#endif
+  }
+
+  return true;
+}
+
+void HttpConnection::close()
+{
+#ifdef CXXPM_HAVE_OPENSSL
+  if (Ssl_)
+    SSL_free(Ssl_);
+  Ssl_ = nullptr;
+#endif
+  if (Fd_ != -1)
+    ::close(Fd_);
+  Fd_ = -1;
+  Begin_ = End_ = 0;
+  Closed_ = false;
+}
+
+bool HttpConnection::write(const void *data, size_t size)
+{
+#ifndef __APPLE__
+  SigPipeGuard guard;
+#endif
+  const uint8_t *p = static_cast<const uint8_t*>(data);
+  while (size) {
+#ifdef CXXPM_HAVE_OPENSSL
+    if (Ssl_) {
+      int result = SSL_write(Ssl_, p, static_cast<int>(std::min(size, static_cast<size_t>(1u << 30))));
+      if (result <= 0) {
+        ERR_clear_error();
+        return false;
+      }
+      p += result;
+      size -= result;
+      continue;
+    }
+#endif
+    ssize_t result = ::send(Fd_, p, size, 0);
+    if (result < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    p += result;
+    size -= result;
+  }
   return true;
 }
 
+bool HttpConnection::fill()
+{
+  if (Begin_ == End_) {
+    Begin_ = End_ = 0;
+  } else if (End_ == ReceiveBufferSize) {
+    if (Begin_ == 0)
+      return false;
+    memmove(Buffer_.get(), Buffer_.get() + Begin_, End_ - Begin_);
+    End_ -= Begin_;
+    Begin_ = 0;
+  }
+
+  uint8_t *p = Buffer_.get() + End_;
+  size_t size = ReceiveBufferSize - End_;
+  for (;;) {
+#ifdef CXXPM_HAVE_OPENSSL
+    if (Ssl_) {
+      int result = SSL_read(Ssl_, p, static_cast<int>(size));
+      if (result > 0) {
+        End_ += result;
+        return true;
+      }
+      Closed_ = SSL_get_error(Ssl_, result) == SSL_ERROR_ZERO_RETURN;
+      ERR_clear_error();
+      return false;
+    }
 #endif
+    ssize_t result = ::recv(Fd_, p, size, 0);
+    if (result > 0) {
+      End_ += result;
+      return true;
+    }
+    if (result < 0 && errno == EINTR)
+      continue;
+    Closed_ = result == 0;
+    return false;
+  }
+}
 
-bool httpDownloadToMemory(const std::string &url, std::vector<uint8_t> &data)
+bool HttpConnection::readLine(std::string &line)
 {
-  return httpDownloadImpl(url, data);
+  size_t scanned = 0;
+  for (;;) {
+    const uint8_t *begin = data();
+    const uint8_t *newLine = static_cast<const uint8_t*>(memchr(begin + scanned, '\n', available() - scanned));
+    if (newLine) {
+      size_t size = newLine - begin;
+      line.assign(reinterpret_cast<const char*>(begin), size > 0 && newLine[-1] == '\r' ? size - 1 : size);
+      consume(size + 1);
+      return true;
+    }
+    scanned = available();
+    if (!fill())
+      return false;
+  }
 }
 
-bool httpDownloadFile(const std::string &url, const std::filesystem::path &destPath)
+struct CHttpResponse {
+  unsigned Status = 0;
+  bool Http11 = false;
+  // Header names in lower case
+  std::map<std::string, std::string> Headers;
+
+  const std::string *header(const char *name) const {
+    auto It = Headers.find(name);
+    return It != Headers.end() ? &It->second : nullptr;
+  }
+};
+
+static bool readResponseHead(HttpConnection &connection, CHttpResponse &response)
+{
+  // Informational responses (1xx) skipped
+  do {
+    std::string line;
+    if (!connection.readLine(line) || line.compare(0, 5, "HTTP/") != 0)
+      return false;
+    size_t space = line.find(' ');
+    if (space == std::string::npos)
+      return false;
+    response.Status = static_cast<unsigned>(strtoul(line.c_str() + space + 1, nullptr, 10));
+    response.Http11 = line.compare(0, space, "HTTP/1.0") != 0;
+    response.Headers.clear();
+    for (;;) {
+      if (!connection.readLine(line))
+        return false;
+      if (line.empty())
+        break;
+      size_t colon = line.find(':');
+      if (colon == std::string::npos)
+        continue;
+      size_t valueBegin = line.find_first_not_of(" \t", colon + 1);
+      size_t valueEnd = line.find_last_not_of(" \t");
+      std::string value = valueBegin != std::string::npos ? line.substr(valueBegin, valueEnd + 1 - valueBegin) : std::string();
+      std::string &field = response.Headers[toLower(line.substr(0, colon))];
+      field = field.empty() ? value : field + ", " + value;
+    }
+  } while (response.Status >= 100 && response.Status < 200);
+  return true;
+}
+
+// Body framed by chunked transfer coding, Content-Length or connection close
+static bool readBody(HttpConnection &connection, const CHttpResponse &response, const HttpSink &sink)
 {
-  std::vector<uint8_t> data;
-  if (!httpDownloadImpl(url, data))
+  auto forward = [&connection, &sink](uint64_t size) -> bool {
+    while (size) {
+      if (!connection.available() && !connection.fill())
+        return false;
+      size_t chunk = static_cast<size_t>(std::min(static_cast<uint64_t>(connection.available()), size));
+      if (!sink(connection.data(), chunk))
+        return false;
+      connection.consume(chunk);
+      size -= chunk;
+    }
+    return true;
+  };
+
+  if (response.Status == 204 || response.Status == 304)
+    return true;
+
+  const std::string *transferEncoding = response.header("transfer-encoding");
+  if (transferEncoding && toLower(*transferEncoding).find("chunked") != std::string::npos) {
+    std::string line;
+    for (;;) {
+      if (!connection.readLine(line))
+        return false;
+      char *end = nullptr;
+      uint64_t chunkSize = strtoull(line.c_str(), &end, 16);
+      if (end == line.c_str())
+        return false;
+      if (chunkSize == 0)
+        break;
+      if (!forward(chunkSize) || !connection.readLine(line) || !line.empty())
+        return false;
+    }
+    // Trailer fields
+    do {
+      if (!connection.readLine(line))
+        return false;
+    } while (!line.empty());
+    return true;
+  }
+
+  const std::string *contentLength = response.header("content-length");
+  if (contentLength) {
+    char *end = nullptr;
+    uint64_t size = strtoull(contentLength->c_str(), &end, 10);
+    if (end == contentLength->c_str())
+      return false;
+    return forward(size);
+  }
+
+  for (;;) {
+    if (connection.available()) {
+      if (!sink(connection.data(), connection.available()))
+        return false;
+      connection.consume(connection.available());
+    }
+    if (!connection.fill())
+      return connection.closed();
+  }
+}
+
+// Connection can be reused after body was read completely
+static bool keepAlive(const CHttpResponse &response)
+{
+  const std::string *connection = response.header("connection");
+  std::string value = connection ? toLower(*connection) : std::string();
+  if (value.find("close") != std::string::npos || (!response.Http11 && value.find("keep-alive") == std::string::npos))
+    return false;
+  // Body delimited by connection close
+  return response.Status == 204 || response.Status == 304 || response.header("transfer-encoding") || response.header("content-length");
+}
+
+#ifndef CXXPM_HAVE_OPENSSL
+// Built without TLS support: HTTPS body streamed from wget through pipe
+static bool wgetDownload(const std::string &url, const HttpResponseHandler &onResponse, const HttpSink &sink)
+{
+  // Close-on-exec: build processes forked by other install workers must not hold write end
+  int fds[2];
+  if (!pipeCloseOnExec(fds)) {
+    fprintf(stderr, "ERROR: can't create pipe\n");
     return false;
+  }
 
-  FILE *f = fopen(destPath.string().c_str(), "wb");
-  if (!f) {
-    fprintf(stderr, "ERROR: can't create file %s\n", destPath.string().c_str());
+  pid_t pid = fork();
+  if (pid == 0) {
+    dup2(fds[1], STDOUT_FILENO);
+    ::close(fds[0]);
+    ::close(fds[1]);
+    execlp("wget", "wget", "-q", "-O", "-", url.c_str(), static_cast<char*>(nullptr));
+    _exit(127);
+  }
+  ::close(fds[1]);
+  if (pid == -1) {
+    ::close(fds[0]);
+    fprintf(stderr, "ERROR: can't start wget\n");
     return false;
   }
 
-  fwrite(data.data(), 1, data.size(), f);
+  // No range requests and headers: response seen as full body of unknown size
+  CHttpResponseInfo info;
+  info.Status = 200;
+  std::unique_ptr<uint8_t[]> buffer(new uint8_t[ReceiveBufferSize]);
+  bool aborted = onResponse && !onResponse(info);
+  if (aborted)
+    kill(pid, SIGTERM);
+  while (!aborted) {
+    ssize_t bytesRead = read(fds[0], buffer.get(), ReceiveBufferSize);
+    if (bytesRead < 0 && errno == EINTR)
+      continue;
+    if (bytesRead <= 0)
+      break;
+    if (!sink(buffer.get(), bytesRead)) {
+      aborted = true;
+      kill(pid, SIGTERM);
+      break;
+    }
+  }
+  ::close(fds[0]);
+
+  int status = 0;
+  while (waitpid(pid, &status, 0) == -1 && errno == EINTR)
+    continue;
+  if (aborted)
+    return false;
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    fprintf(stderr, "ERROR: wget failed for %s\n", url.c_str());
+    return false;
+  }
+  return true;
+}
+#endif
+
+static bool httpRequestImpl(HttpClient *client, const std::string &url, const CHttpRange &range, const HttpResponseHandler &onResponse, const HttpSink &sink)
+{
+  std::string location = url;
+  for (unsigned redirects = 0;; redirects++) {
+    CUrl parsed;
+    if (!parseUrl(location, parsed)) {
+      fprintf(stderr, "ERROR: can't parse URL: %s\n", location.c_str());
+      return false;
+    }
+#ifndef CXXPM_HAVE_OPENSSL
+    if (parsed.Https)
+      return wgetDownload(location, onResponse, sink);
+#endif
+
+    std::string origin = parsed.Scheme + "://" + parsed.Authority;
+    std::unique_ptr<HttpConnection> connection = client ? client->acquire(origin) : nullptr;
+    bool reused = connection != nullptr;
+
+    std::string request =
+      "GET " + parsed.Target + " HTTP/1.1\r\n"
+      "Host: " + parsed.Authority + "\r\n"
+      "User-Agent: cxx-pm/" CXXPM_VERSION "\r\n"
+      "Accept: */*\r\n"
+      "Accept-Encoding: identity\r\n" +
+      rangeHeaders(range) +
+      (client ? "" : "Connection: close\r\n") +
+      "\r\n";
+    CHttpResponse response;
+    for (;;) {
+      if (!connection) {
+        connection.reset(new HttpConnection);
+        if (!connection->connect(parsed))
+          return false;
+      }
+      if (connection->write(request.data(), request.size()) && readResponseHead(*connection, response))
+        break;
+      if (!reused) {
+        fprintf(stderr, "ERROR: no response from %s\n", location.c_str());
+        return false;
+      }
+      // Idle connection closed by server, request repeated on new one
+      connection.reset();
+      reused = false;
+    }
+
+    auto release = [&]() {
+      if (client && keepAlive(response))
+        client->release(origin, std::move(connection));
+    };
+
+    unsigned status = response.Status;
+    if (status == 301 || status == 302 || status == 303 || status == 307 || status == 308) {
+      const std::string *target = response.header("location");
+      if (!target || redirects == MaxRedirects) {
+        fprintf(stderr, "ERROR: invalid redirect for %s\n", location.c_str());
+        return false;
+      }
+      location = resolveLocation(parsed, *target);
+      if (readBody(*connection, response, [](const uint8_t*, size_t) { return true; }))
+        release();
+      continue;
+    }
+
+    CHttpResponseInfo info;
+    info.Status = status;
+    for (auto [name, field] : {std::make_pair("content-length", &info.ContentLength),
+                               std::make_pair("content-range", &info.ContentRange),
+                               std::make_pair("accept-ranges", &info.AcceptRanges),
+                               std::make_pair("etag", &info.ETag),
+                               std::make_pair("last-modified", &info.LastModified)}) {
+      if (const std::string *value = response.header(name))
+        *field = *value;
+    }
+    if (!acceptResponse(location, range, info, onResponse))
+      return false;
+
+    bool aborted = false;
+    bool success = readBody(*connection, response, [&sink, &aborted](const uint8_t *data, size_t size) {
+      aborted = !sink(data, size);
+      return !aborted;
+    });
+    if (!success && !aborted)
+      fprintf(stderr, "ERROR: connection lost while downloading %s\n", location.c_str());
+    if (success)
+      release();
+    return success;
+  }
+}
+
+HttpClient::HttpClient() {}
+
+HttpClient::~HttpClient() {}
+
+std::unique_ptr<HttpConnection> HttpClient::acquire(const std::string &origin)
+{
+  std::lock_guard<std::mutex> lock(Mutex_);
+  // Most recently used connection is least likely closed by server
+  for (size_t i = Idle_.size(); i-- > 0;) {
+    if (Idle_[i].first == origin) {
+      std::unique_ptr<HttpConnection> connection = std::move(Idle_[i].second);
+      Idle_.erase(Idle_.begin() + i);
+      return connection;
+    }
+  }
+  return nullptr;
+}
+
+void HttpClient::release(const std::string &origin, std::unique_ptr<HttpConnection> connection)
+{
+  std::lock_guard<std::mutex> lock(Mutex_);
+  if (Idle_.size() == MaxIdleConnections)
+    Idle_.erase(Idle_.begin());
+  Idle_.emplace_back(origin, std::move(connection));
+}
+
+#endif
+
+static bool downloadImpl(HttpClient *client, const std::string &url, const HttpSink &sink, uint64_t expectedSize)
+{
+  // Body larger than expected rejected before it reaches sink
+  uint64_t received = 0;
+  bool sizeMismatch = false;
+  auto onResponse = [&](const CHttpResponseInfo &info) {
+    sizeMismatch = expectedSize && info.TotalSize && info.TotalSize != expectedSize;
+    return !sizeMismatch;
+  };
+  bool success = httpRequestImpl(client, url, CHttpRange(), onResponse, [&](const uint8_t *data, size_t size) {
+    received += size;
+    sizeMismatch = expectedSize && received > expectedSize;
+    return !sizeMismatch && sink(data, size);
+  });
+  if (sizeMismatch || (success && expectedSize && received != expectedSize)) {
+    fprintf(stderr, "ERROR: size of %s not matches expected %llu bytes\n", url.c_str(), static_cast<unsigned long long>(expectedSize));
+    return false;
+  }
+  return success;
+}
+
+static bool downloadToMemoryImpl(HttpClient *client, const std::string &url, std::vector<uint8_t> &data, uint64_t expectedSize)
+{
+  data.clear();
+  data.reserve(expectedSize);
+  return downloadImpl(client, url, [&data](const uint8_t *chunk, size_t size) {
+    data.insert(data.end(), chunk, chunk + size);
+    return true;
+  }, expectedSize);
+}
+
+bool httpDownload(const std::string &url, const HttpSink &sink, uint64_t expectedSize)
+{
+  return downloadImpl(nullptr, url, sink, expectedSize);
+}
+
+bool httpDownloadToMemory(const std::string &url, std::vector<uint8_t> &data, uint64_t expectedSize)
+{
+  return downloadToMemoryImpl(nullptr, url, data, expectedSize);
+}
+
+bool HttpClient::download(const std::string &url, const HttpSink &sink, uint64_t expectedSize)
+{
+  return downloadImpl(this, url, sink, expectedSize);
+}
+
+bool HttpClient::downloadToMemory(const std::string &url, std::vector<uint8_t> &data, uint64_t expectedSize)
+{
+  return downloadToMemoryImpl(this, url, data, expectedSize);
+}
+
+// <file>.part.meta: URL and validator of partially downloaded <file>.part
+static bool loadPartMeta(const std::filesystem::path &path, const std::string &url, std::string &validator)
+{
+  FILE *f = fopen(path.string().c_str(), "rb");
+  if (!f)
+    return false;
+  char buffer[4096];
+  size_t size = fread(buffer, 1, sizeof(buffer) - 1, f);
+  fclose(f);
+  buffer[size] = 0;
+  const char *newLine = strchr(buffer, '\n');
+  if (!newLine || std::string(buffer, newLine - buffer) != url)
+    return false;
+  validator = newLine + 1;
+  while (!validator.empty() && (validator.back() == '\n' || validator.back() == '\r'))
+    validator.pop_back();
+  return !validator.empty();
+}
+
+static bool storePartMeta(const std::filesystem::path &path, const std::string &url, const std::string &validator)
+{
+  FILE *f = fopen(path.string().c_str(), "wb");
+  if (!f)
+    return false;
+  bool success = fprintf(f, "%s\n%s\n", url.c_str(), validator.c_str()) > 0;
+  success &= fclose(f) == 0;
+  return success;
+}
+
+// Part downloaded before passed to observer, so it sees whole file
+static bool observePart(const std::filesystem::path &path, uint64_t size, const HttpSink &observer)
+{
+  FILE *f = fopen(path.string().c_str(), "rb");
+  if (!f)
+    return false;
+  std::unique_ptr<uint8_t[]> buffer(new uint8_t[1u << 16]);
+  bool success = true;
+  while (success && size) {
+    size_t bytesRead = fread(buffer.get(), 1, static_cast<size_t>(std::min<uint64_t>(size, 1u << 16)), f);
+    success = bytesRead != 0 && observer(buffer.get(), bytesRead);
+    size -= bytesRead;
+  }
   fclose(f);
+  return success;
+}
+
+// Large files fetched as several byte ranges over parallel connections
+// Smallest segmented file, see httpDownloadFile description
+static constexpr uint64_t MinSegmentedFileSize = 32u << 20;
+static constexpr uint64_t MinSegmentSize = MinSegmentedFileSize / 2;
+static constexpr unsigned MaxSegments = 4;
+static constexpr unsigned SegmentAttempts = 3;
+
+struct CDownloadSegment {
+  uint64_t Begin = 0;
+  uint64_t End = 0;
+  // Bytes written to file from Begin
+  uint64_t Received = 0;
+  bool Finished = false;
+  bool Failed = false;
+};
+
+// First segment continues on connection which detected range support; others started in own threads.
+// Observer receives data in file order while later segments still downloading.
+class SegmentedDownload {
+public:
+  SegmentedDownload(const std::string &url, uint64_t totalSize, const std::string &validator) : Url_(url), TotalSize_(totalSize), Validator_(validator) {}
+  ~SegmentedDownload() { cancel(); join(); }
+
+  // Server must support ranges and provide validator, so all segments come from same resource version
+  // Returns 1 (single connection download) if file can't or shouldn't be split
+  static unsigned segmentsNum(const CHttpResponseInfo &info, const std::string &validator);
+
+  bool start(const std::filesystem::path &partPath, unsigned segmentsNum);
+  // Sink of first connection; returns false when first segment complete
+  bool writeFirst(const uint8_t *data, size_t size);
+  // Completes first segment if its connection was lost, feeds observer, waits other segments
+  bool finish(const HttpSink &observer);
+
+private:
+  std::string Url_;
+  uint64_t TotalSize_;
+  std::string Validator_;
+  RandomAccessFile File_;
+  std::vector<CDownloadSegment> Segments_;
+  std::vector<std::thread> Threads_;
+  std::mutex Mutex_;
+  std::condition_variable Progress_;
+  bool Cancelled_ = false;
+  bool Failed_ = false;
+  bool WriteError_ = false;
+
+  bool write(CDownloadSegment &segment, const uint8_t *data, size_t size);
+  void fetch(CDownloadSegment &segment);
+  void cancel();
+  void join();
+};
+
+unsigned SegmentedDownload::segmentsNum(const CHttpResponseInfo &info, const std::string &validator)
+{
+  if (info.Status != 200 || validator.empty() || info.AcceptRanges.find("bytes") == std::string::npos ||
+      info.TotalSize < MinSegmentedFileSize)
+    return 1;
+  return static_cast<unsigned>(std::max<uint64_t>(1, std::min<uint64_t>(info.TotalSize / MinSegmentSize, MaxSegments)));
+}
+
+bool SegmentedDownload::start(const std::filesystem::path &partPath, unsigned segmentsNum)
+{
+  if (!File_.create(partPath) || !File_.resize(TotalSize_)) {
+    fprintf(stderr, "ERROR: can't write file %s\n", partPath.string().c_str());
+    return false;
+  }
+
+  Segments_.resize(segmentsNum);
+  uint64_t segmentSize = TotalSize_ / segmentsNum;
+  for (unsigned i = 0; i < segmentsNum; i++) {
+    Segments_[i].Begin = i * segmentSize;
+    Segments_[i].End = i + 1 == segmentsNum ? TotalSize_ : (i + 1) * segmentSize;
+  }
+
+  for (unsigned i = 1; i < segmentsNum; i++)
+    Threads_.emplace_back([this, i]() { fetch(Segments_[i]); });
   return true;
 }
+
+bool SegmentedDownload::write(CDownloadSegment &segment, const uint8_t *data, size_t size)
+{
+  uint64_t offset = segment.Begin + segment.Received;
+  size = static_cast<size_t>(std::min<uint64_t>(size, segment.End - offset));
+  bool success = File_.writeAt(offset, data, size);
+  {
+    std::lock_guard<std::mutex> lock(Mutex_);
+    WriteError_ |= !success;
+    if (success)
+      segment.Received += size;
+    success &= !Cancelled_;
+  }
+  Progress_.notify_all();
+  return success && segment.Begin + segment.Received < segment.End;
+}
+
+bool SegmentedDownload::writeFirst(const uint8_t *data, size_t size)
+{
+  return write(Segments_[0], data, size);
+}
+
+void SegmentedDownload::fetch(CDownloadSegment &segment)
+{
+  for (unsigned attempt = 0; attempt < SegmentAttempts && segment.Begin + segment.Received < segment.End; attempt++) {
+    {
+      std::lock_guard<std::mutex> lock(Mutex_);
+      if (Cancelled_)
+        break;
+    }
+
+    CHttpRange range;
+    range.Begin = segment.Begin + segment.Received;
+    range.End = segment.End;
+    range.IfRange = Validator_;
+    // 200 means resource changed since first response, retry is useless
+    bool changed = false;
+    auto onResponse = [this, &changed](const CHttpResponseInfo &info) {
+      changed = info.Status != 206 || info.TotalSize != TotalSize_;
+      if (changed)
+        fprintf(stderr, "ERROR: %s changed while downloading\n", Url_.c_str());
+      return !changed;
+    };
+    httpRequestImpl(nullptr, Url_, range, onResponse, [this, &segment](const uint8_t *data, size_t size) {
+      return write(segment, data, size);
+    });
+    if (changed)
+      break;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(Mutex_);
+    segment.Finished = true;
+    segment.Failed = segment.Begin + segment.Received != segment.End;
+    Failed_ |= segment.Failed;
+  }
+  Progress_.notify_all();
+}
+
+bool SegmentedDownload::finish(const HttpSink &observer)
+{
+  fetch(Segments_[0]);
+
+  std::unique_ptr<uint8_t[]> buffer(new uint8_t[1u << 20]);
+  bool success = true;
+  for (CDownloadSegment &segment : Segments_) {
+    uint64_t observed = 0;
+    while (success && observed < segment.End - segment.Begin) {
+      uint64_t available;
+      {
+        std::unique_lock<std::mutex> lock(Mutex_);
+        Progress_.wait(lock, [&]() { return segment.Received > observed || segment.Finished || Failed_ || WriteError_; });
+        success = !Failed_ && !WriteError_;
+        available = segment.Received;
+      }
+
+      while (success && observed < available) {
+        size_t size = static_cast<size_t>(std::min<uint64_t>(available - observed, 1u << 20));
+        success = File_.readAt(segment.Begin + observed, buffer.get(), size) && (!observer || observer(buffer.get(), size));
+        observed += size;
+      }
+    }
+  }
+
+  if (!success)
+    cancel();
+  join();
+  success &= !WriteError_;
+  if (WriteError_)
+    fprintf(stderr, "ERROR: can't write downloaded data of %s\n", Url_.c_str());
+  success &= File_.close();
+  return success;
+}
+
+void SegmentedDownload::cancel()
+{
+  std::lock_guard<std::mutex> lock(Mutex_);
+  Cancelled_ = true;
+}
+
+void SegmentedDownload::join()
+{
+  for (std::thread &thread : Threads_)
+    thread.join();
+  Threads_.clear();
+}
+
+bool httpDownloadFile(const std::string &url,
+                      const std::filesystem::path &destPath,
+                      const HttpSink &observer,
+                      uint64_t expectedSize)
+{
+  std::filesystem::path partPath = destPath;
+  std::filesystem::path metaPath = destPath;
+  partPath += ".part";
+  metaPath += ".part.meta";
+
+  std::error_code ec;
+  CHttpRange range;
+  if (loadPartMeta(metaPath, url, range.IfRange)) {
+    uint64_t partSize = std::filesystem::file_size(partPath, ec);
+    if (!ec && partSize)
+      range.Begin = partSize;
+  }
+
+  // Second attempt from scratch if server can't satisfy range
+  for (unsigned attempt = 0; attempt < 2; attempt++) {
+    if (range.empty()) {
+      std::filesystem::remove(metaPath, ec);
+      range.IfRange.clear();
+    }
+
+    FILE *f = nullptr;
+    std::unique_ptr<SegmentedDownload> segmented;
+    uint64_t received = 0;
+    bool writeError = false;
+    bool sizeMismatch = false;
+    bool observerFailed = false;
+    CHttpResponseInfo response;
+    auto onResponse = [&](const CHttpResponseInfo &info) {
+      response = info;
+      if (info.Status == 416)
+        return false;
+      sizeMismatch = expectedSize && info.TotalSize && info.TotalSize != expectedSize;
+      if (sizeMismatch)
+        return false;
+
+      // Strong validator only can be used with If-Range
+      std::string validator = info.ETag.compare(0, 2, "W/") != 0 ? info.ETag : std::string();
+      if (validator.empty())
+        validator = info.LastModified;
+
+      // Segmented download leaves holes in file on failure, it can't be resumed
+      unsigned segmentsNum = SegmentedDownload::segmentsNum(info, validator);
+      if (segmentsNum > 1) {
+        segmented.reset(new SegmentedDownload(url, info.TotalSize, validator));
+        std::filesystem::remove(metaPath, ec);
+        writeError = !segmented->start(partPath, segmentsNum);
+        return !writeError;
+      }
+
+      // Server ignored range (resource changed or ranges not supported): start from beginning
+      bool resume = info.Offset != 0;
+      if (resume) {
+        printf("Resuming download from %llu bytes\n", static_cast<unsigned long long>(info.Offset));
+        fflush(stdout);
+      }
+      f = fopen(partPath.string().c_str(), resume ? "ab" : "wb");
+      if (!f) {
+        writeError = true;
+        return false;
+      }
+      received = info.Offset;
+      if (resume && observer && !observePart(partPath, info.Offset, observer)) {
+        observerFailed = true;
+        return false;
+      }
+
+      if (!validator.empty() && !storePartMeta(metaPath, url, validator))
+        std::filesystem::remove(metaPath, ec);
+      return true;
+    };
+
+    bool success = httpRequestImpl(nullptr, url, range, onResponse, [&](const uint8_t *data, size_t size) {
+      if (segmented)
+        return segmented->writeFirst(data, size);
+      received += size;
+      sizeMismatch = expectedSize && received > expectedSize;
+      if (sizeMismatch)
+        return false;
+      writeError = fwrite(data, 1, size, f) != size;
+      return !writeError && (!observer || observer(data, size));
+    });
+    if (f)
+      writeError |= fclose(f) != 0;
+    if (segmented && !writeError) {
+      // First connection aborted at end of its segment
+      success = segmented->finish(observer);
+      received = response.TotalSize;
+    }
+
+    if (response.Status == 416 && !range.empty()) {
+      range = CHttpRange();
+      continue;
+    }
+
+    if (sizeMismatch || (success && expectedSize && received != expectedSize)) {
+      fprintf(stderr, "ERROR: size of %s not matches expected %llu bytes\n", url.c_str(), static_cast<unsigned long long>(expectedSize));
+      success = false;
+    }
+    if (writeError)
+      fprintf(stderr, "ERROR: can't write file %s\n", partPath.string().c_str());
+
+    if (success && !writeError) {
+      std::filesystem::rename(partPath, destPath, ec);
+      if (ec) {
+        fprintf(stderr, "ERROR: can't write file %s\n", destPath.string().c_str());
+        return false;
+      }
+      std::filesystem::remove(metaPath, ec);
+      return true;
+    }
+
+    // Keep interrupted download if it can be resumed
+    if (sizeMismatch || writeError || observerFailed || !std::filesystem::exists(metaPath)) {
+      std::filesystem::remove(partPath, ec);
+      std::filesystem::remove(metaPath, ec);
+    }
+    return false;
+  }
+
+  return false;
+}
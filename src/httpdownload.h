@@ -3,10 +3,61 @@
 #include <string>
 #include <vector>
 #include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <stdint.h>
 
-// Download URL to file. Returns true on success.
-bool httpDownloadFile(const std::string &url, const std::filesystem::path &destPath);
+// Receives response body while it arrives; return false to abort download
+using HttpSink = std::function<bool(const uint8_t *data, size_t size)>;
+
+// Stream body of URL to sink, memory usage bounded by receive buffer. Returns true on success.
+// Linux/macOS: in-process HTTP/1.1 client (HTTPS with OpenSSL, wget used if built without it)
+// Windows: WinHTTP
+// expectedSize: if not zero, download aborted as soon as Content-Length or received data not match it
+bool httpDownload(const std::string &url, const HttpSink &sink, uint64_t expectedSize = 0);
+
+// Download URL to file, written as data arrives; 'observer' also receives all data (to hash it, for example)
+// Data goes to <destPath>.part, renamed to destPath on success. Interrupted download is kept if server
+// provided validator (strong ETag or Last-Modified) and resumed next time with Range/If-Range request.
+// Files of 32 MB and more are fetched as up to 4 byte ranges over parallel connections when server supports
+// ranges; observer still receives data in file order.
+bool httpDownloadFile(const std::string &url,
+                      const std::filesystem::path &destPath,
+                      const HttpSink &observer = nullptr,
+                      uint64_t expectedSize = 0);
 
 // Download URL to memory. Returns true on success.
-bool httpDownloadToMemory(const std::string &url, std::vector<uint8_t> &data);
+bool httpDownloadToMemory(const std::string &url, std::vector<uint8_t> &data, uint64_t expectedSize = 0);
+
+class HttpConnection;
+
+// Keeps connections open between requests (HTTP/1.1 keep-alive), so series of small downloads from same
+// host don't pay TCP and TLS handshake each. One client can be used from several threads at once.
+class HttpClient {
+public:
+  HttpClient();
+  ~HttpClient();
+  HttpClient(const HttpClient&) = delete;
+  HttpClient &operator=(const HttpClient&) = delete;
+
+  bool download(const std::string &url, const HttpSink &sink, uint64_t expectedSize = 0);
+  bool downloadToMemory(const std::string &url, std::vector<uint8_t> &data, uint64_t expectedSize = 0);
+
+  // Used by request implementation
+#ifdef WIN32
+  void *session() const { return Session_; }
+#else
+  // Idle connection to origin ("scheme://authority") or nullptr
+  std::unique_ptr<HttpConnection> acquire(const std::string &origin);
+  void release(const std::string &origin, std::unique_ptr<HttpConnection> connection);
+#endif
+
+private:
+#ifdef WIN32
+  void *Session_ = nullptr;
+#else
+  std::mutex Mutex_;
+  std::vector<std::pair<std::string, std::unique_ptr<HttpConnection>>> Idle_;
+#endif
+};
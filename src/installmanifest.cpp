@@ -0,0 +1,760 @@
+#include "installmanifest.h"
+#include "os.h"
+#include "parallel.h"
+#include "sha3Tools.h"
+#include "strExtras.h"
+#include "json/json11.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+// Time budget of sampled verification
+static constexpr std::chrono::milliseconds SampledBudget(125);
+
+// Files hashed together by one thread with multi-buffer sha3
+static constexpr size_t HashBatchFiles = 16;
+static constexpr uint64_t HashBatchBytes = 1u << 20;
+
+bool verifyModeFromString(const std::string &name, EVerifyMode &mode)
+{
+  if (name == "fast")
+    mode = EVerifyMode::Fast;
+  else if (name == "sampled")
+    mode = EVerifyMode::Sampled;
+  else if (name == "full")
+    mode = EVerifyMode::Full;
+  else
+    return false;
+  return true;
+}
+
+const char *verifyModeToString(EVerifyMode mode)
+{
+  switch (mode) {
+    case EVerifyMode::Fast : return "fast";
+    case EVerifyMode::Sampled : return "sampled";
+    case EVerifyMode::Full : return "full";
+  }
+  return "unknown";
+}
+
+static const char *ManifestV2Header = "#cxx-pm-manifest v2";
+static const char BinaryManifestMagic[8] = {'C', 'X', 'X', 'P', 'M', 'M', 'F', 0};
+static constexpr uint32_t BinaryManifestVersion = 1;
+static constexpr uint32_t BinaryManifestHasStat = 1;
+static const char SuffixIndexMagic[8] = {'C', 'X', 'X', 'P', 'M', 'S', 'X', 0};
+static constexpr uint32_t SuffixIndexVersion = 1;
+
+static bool parseStat(const std::string &data, CFileStat &stat)
+{
+  unsigned long long size;
+  long long mtime;
+  unsigned long long inode;
+  char tail;
+  if (sscanf(data.c_str(), "!%llu!%lld!%llu%c", &size, &mtime, &inode, &tail) != 3)
+    return false;
+  stat.Size = size;
+  stat.MTime = mtime;
+  stat.Inode = inode;
+  return true;
+}
+
+static bool sameStat(const CFileStat &l, const CFileStat &r)
+{
+  return l.Size == r.Size && l.MTime == r.MTime && l.Inode == r.Inode;
+}
+
+static bool isHex(const std::string &s)
+{
+  for (char c: s) {
+    if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F')))
+      return false;
+  }
+  return true;
+}
+
+static bool textManifestLoad(const std::filesystem::path &path, std::vector<CInstallManifestEntry> &entries)
+{
+  std::ifstream hManifest(path);
+  if (!hManifest)
+    return false;
+
+  std::string line;
+  bool v2 = false;
+  bool firstLine = true;
+  while (std::getline(hManifest, line)) {
+    if (firstLine) {
+      firstLine = false;
+      if (line == ManifestV2Header) {
+        v2 = true;
+        continue;
+      }
+    }
+
+    size_t pos = line.find('!');
+    if (pos == std::string::npos || pos == 0 || line.size()-pos < 65 || !isHex(line.substr(pos+1, 64))) {
+      fprintf(stderr, "WARNING: broken manifest %s\n", path.string().c_str());
+      return false;
+    }
+
+    CInstallManifestEntry &entry = entries.emplace_back();
+    entry.Path = line.substr(0, pos);
+    hex2bin(line.data() + pos + 1, 64, entry.Digest);
+    // v2 entry without stat data written in v1 form
+    if (v2 && line.size() > pos+65) {
+      if (!parseStat(line.substr(pos+65), entry.Stat)) {
+        fprintf(stderr, "WARNING: broken manifest %s\n", path.string().c_str());
+        return false;
+      }
+      entry.HasStat = true;
+    }
+  }
+
+  return true;
+}
+
+static bool writeFile(const std::filesystem::path &path, const void *data, size_t size)
+{
+  // Write to temporary file and rename: manifest can be mapped by other cxx-pm process right now
+  std::filesystem::path tmpPath = uniqueTempPath(path);
+  FILE *hFile = fopen(tmpPath.string().c_str(), "wb");
+  if (!hFile) {
+    fprintf(stderr, "ERROR: can't open manifest file %s\n", tmpPath.string().c_str());
+    return false;
+  }
+
+  bool result = fwrite(data, 1, size, hFile) == size;
+  result &= fclose(hFile) == 0;
+  std::error_code ec;
+  if (!result) {
+    fprintf(stderr, "ERROR: can't write manifest file %s\n", tmpPath.string().c_str());
+    std::filesystem::remove(tmpPath, ec);
+    return false;
+  }
+
+  std::filesystem::rename(tmpPath, path, ec);
+  if (ec) {
+    fprintf(stderr, "ERROR: can't write manifest file %s\n", path.string().c_str());
+    std::filesystem::remove(tmpPath, ec);
+    return false;
+  }
+
+  return true;
+}
+
+static void serializeBinaryManifest(std::vector<CInstallManifestEntry> &entries, std::vector<uint8_t> &out)
+{
+  std::sort(entries.begin(), entries.end(), [](const CInstallManifestEntry &l, const CInstallManifestEntry &r) {
+    return l.Path < r.Path;
+  });
+
+  CBinaryManifestHeader header;
+  memcpy(header.Magic, BinaryManifestMagic, sizeof(BinaryManifestMagic));
+  header.Version = BinaryManifestVersion;
+  header.Flags = 0;
+  header.EntriesNum = entries.size();
+  header.StringsSize = 0;
+  for (const auto &entry: entries)
+    header.StringsSize += entry.Path.size();
+
+  out.resize(sizeof(CBinaryManifestHeader) + sizeof(CBinaryManifestEntry)*entries.size() + header.StringsSize);
+  memcpy(out.data(), &header, sizeof(header));
+  CBinaryManifestEntry *binaryEntries = reinterpret_cast<CBinaryManifestEntry*>(out.data() + sizeof(CBinaryManifestHeader));
+  char *strings = reinterpret_cast<char*>(binaryEntries + entries.size());
+
+  uint64_t offset = 0;
+  for (size_t i = 0; i < entries.size(); i++) {
+    const CInstallManifestEntry &entry = entries[i];
+    CBinaryManifestEntry &binaryEntry = binaryEntries[i];
+    binaryEntry.PathOffset = offset;
+    binaryEntry.PathSize = static_cast<uint32_t>(entry.Path.size());
+    binaryEntry.Flags = entry.HasStat ? BinaryManifestHasStat : 0;
+    memcpy(binaryEntry.Digest, entry.Digest, sizeof(entry.Digest));
+    binaryEntry.Size = entry.HasStat ? entry.Stat.Size : 0;
+    binaryEntry.MTime = entry.HasStat ? entry.Stat.MTime : 0;
+    binaryEntry.Inode = entry.HasStat ? entry.Stat.Inode : 0;
+    memcpy(strings + offset, entry.Path.data(), entry.Path.size());
+    offset += entry.Path.size();
+  }
+}
+
+// Compare reversed strings
+static int compareReversed(std::string_view l, std::string_view r)
+{
+  size_t size = std::min(l.size(), r.size());
+  for (size_t i = 1; i <= size; i++) {
+    unsigned char cl = l[l.size() - i];
+    unsigned char cr = r[r.size() - i];
+    if (cl != cr)
+      return cl < cr ? -1 : 1;
+  }
+  return l.size() < r.size() ? -1 : (l.size() > r.size() ? 1 : 0);
+}
+
+// Compare reversed 'path' truncated to suffix length with reversed suffix; 0 means path ends with suffix
+static int compareReversedSuffix(std::string_view path, std::string_view suffix)
+{
+  for (size_t i = 1; i <= suffix.size(); i++) {
+    if (i > path.size())
+      return -1;
+    unsigned char cp = path[path.size() - i];
+    unsigned char cs = suffix[suffix.size() - i];
+    if (cp != cs)
+      return cp < cs ? -1 : 1;
+  }
+  return 0;
+}
+
+static void serializeSuffixIndex(const std::vector<CInstallManifestEntry> &entries, std::vector<uint8_t> &out)
+{
+  std::vector<uint32_t> indices(entries.size());
+  for (size_t i = 0; i < entries.size(); i++)
+    indices[i] = static_cast<uint32_t>(i);
+  std::sort(indices.begin(), indices.end(), [&entries](uint32_t l, uint32_t r) {
+    return compareReversed(entries[l].Path, entries[r].Path) < 0;
+  });
+
+  CSuffixIndexHeader header;
+  memcpy(header.Magic, SuffixIndexMagic, sizeof(SuffixIndexMagic));
+  header.Version = SuffixIndexVersion;
+  header.Flags = 0;
+  header.EntriesNum = entries.size();
+  header.StringsSize = 0;
+  for (const auto &entry: entries)
+    header.StringsSize += entry.Path.size();
+
+  out.resize(sizeof(CSuffixIndexHeader) + sizeof(uint32_t)*indices.size());
+  memcpy(out.data(), &header, sizeof(header));
+  if (!indices.empty())
+    memcpy(out.data() + sizeof(CSuffixIndexHeader), indices.data(), sizeof(uint32_t)*indices.size());
+}
+
+bool InstallManifest::attach(const uint8_t *data, size_t size)
+{
+  if (size < sizeof(CBinaryManifestHeader))
+    return false;
+  const CBinaryManifestHeader *header = reinterpret_cast<const CBinaryManifestHeader*>(data);
+  if (memcmp(header->Magic, BinaryManifestMagic, sizeof(BinaryManifestMagic)) != 0 ||
+      header->Version != BinaryManifestVersion ||
+      header->EntriesNum > (size - sizeof(CBinaryManifestHeader)) / sizeof(CBinaryManifestEntry) ||
+      sizeof(CBinaryManifestHeader) + header->EntriesNum*sizeof(CBinaryManifestEntry) + header->StringsSize != size)
+    return false;
+
+  const CBinaryManifestEntry *entries = reinterpret_cast<const CBinaryManifestEntry*>(data + sizeof(CBinaryManifestHeader));
+  for (uint64_t i = 0; i < header->EntriesNum; i++) {
+    if (entries[i].PathOffset > header->StringsSize || entries[i].PathSize > header->StringsSize - entries[i].PathOffset)
+      return false;
+  }
+
+  Header_ = header;
+  Entries_ = entries;
+  Strings_ = reinterpret_cast<const char*>(entries + header->EntriesNum);
+  return true;
+}
+
+bool InstallManifest::open(const std::filesystem::path &prefix)
+{
+  close();
+  std::filesystem::path binaryPath = installManifestPath(prefix);
+  if (File_.open(binaryPath)) {
+    if (attach(File_.data(), File_.size())) {
+      // Suffix index is optional
+      if (SuffixFile_.open(prefix / "manifest.sfx")) {
+        const CSuffixIndexHeader *header = reinterpret_cast<const CSuffixIndexHeader*>(SuffixFile_.data());
+        if (SuffixFile_.size() == sizeof(CSuffixIndexHeader) + sizeof(uint32_t)*Header_->EntriesNum &&
+            memcmp(header->Magic, SuffixIndexMagic, sizeof(SuffixIndexMagic)) == 0 &&
+            header->Version == SuffixIndexVersion &&
+            header->EntriesNum == Header_->EntriesNum &&
+            header->StringsSize == Header_->StringsSize) {
+          SuffixIndex_ = reinterpret_cast<const uint32_t*>(SuffixFile_.data() + sizeof(CSuffixIndexHeader));
+          for (size_t i = 0; i < Header_->EntriesNum; i++) {
+            if (SuffixIndex_[i] >= Header_->EntriesNum) {
+              SuffixIndex_ = nullptr;
+              break;
+            }
+          }
+        }
+      }
+      return true;
+    }
+    fprintf(stderr, "WARNING: broken manifest %s\n", binaryPath.string().c_str());
+    close();
+    return false;
+  }
+
+  // Package installed by older cxx-pm version
+  std::vector<CInstallManifestEntry> entries;
+  if (!textManifestLoad(prefix / "manifest.txt", entries))
+    return false;
+  serializeBinaryManifest(entries, Buffer_);
+  return attach(Buffer_.data(), Buffer_.size());
+}
+
+void InstallManifest::close()
+{
+  File_.close();
+  SuffixFile_.close();
+  SuffixIndex_ = nullptr;
+  Buffer_.clear();
+  Header_ = nullptr;
+  Entries_ = nullptr;
+  Strings_ = nullptr;
+}
+
+bool InstallManifest::stat(size_t index, CFileStat &stat) const
+{
+  const CBinaryManifestEntry &entry = Entries_[index];
+  if (!(entry.Flags & BinaryManifestHasStat))
+    return false;
+  stat.Size = entry.Size;
+  stat.MTime = entry.MTime;
+  stat.Inode = entry.Inode;
+  return true;
+}
+
+size_t InstallManifest::find(std::string_view path) const
+{
+  size_t first = 0;
+  size_t last = size();
+  while (first < last) {
+    size_t middle = first + (last - first) / 2;
+    if (this->path(middle) < path)
+      first = middle + 1;
+    else
+      last = middle;
+  }
+
+  return first < size() && this->path(first) == path ? first : size();
+}
+
+size_t InstallManifest::findSuffix(std::string_view suffix, size_t &index) const
+{
+  if (!SuffixIndex_) {
+    size_t count = 0;
+    for (size_t i = 0, ie = size(); i != ie; ++i) {
+      if (compareReversedSuffix(path(i), suffix) == 0) {
+        if (count++ == 0)
+          index = i;
+      }
+    }
+    return count;
+  }
+
+  // Entries which ends with suffix are continuous range in suffix index
+  const uint32_t *begin = SuffixIndex_;
+  const uint32_t *end = SuffixIndex_ + size();
+  const uint32_t *lower = std::partition_point(begin, end, [this, suffix](uint32_t i) {
+    return compareReversedSuffix(path(i), suffix) < 0;
+  });
+  const uint32_t *upper = std::partition_point(lower, end, [this, suffix](uint32_t i) {
+    return compareReversedSuffix(path(i), suffix) == 0;
+  });
+
+  if (lower != upper)
+    index = *lower;
+  return upper - lower;
+}
+
+void InstallManifest::entries(std::vector<CInstallManifestEntry> &out) const
+{
+  out.resize(size());
+  for (size_t i = 0; i < size(); i++) {
+    out[i].Path = path(i);
+    memcpy(out[i].Digest, digest(i), 32);
+    out[i].HasStat = stat(i, out[i].Stat);
+  }
+}
+
+std::filesystem::path installManifestPath(const std::filesystem::path &prefix)
+{
+  return prefix / "manifest.bin";
+}
+
+bool installManifestStore(const std::filesystem::path &prefix, std::vector<CInstallManifestEntry> &entries, bool text)
+{
+  std::vector<uint8_t> data;
+  serializeBinaryManifest(entries, data);
+  if (!writeFile(installManifestPath(prefix), data.data(), data.size()))
+    return false;
+  serializeSuffixIndex(entries, data);
+  if (!writeFile(prefix / "manifest.sfx", data.data(), data.size()))
+    return false;
+
+  if (text) {
+    std::string content = ManifestV2Header;
+    content.push_back('\n');
+    char hex[65] = {0};
+    for (const auto &entry: entries) {
+      bin2hexLowerCase(entry.Digest, hex, 32);
+      content.append(entry.Path);
+      content.push_back('!');
+      content.append(hex);
+      if (entry.HasStat) {
+        content.append("!" + std::to_string(entry.Stat.Size));
+        content.append("!" + std::to_string(entry.Stat.MTime));
+        content.append("!" + std::to_string(entry.Stat.Inode));
+      }
+      content.push_back('\n');
+    }
+    if (!writeFile(prefix / "manifest.txt", content.data(), content.size()))
+      return false;
+  }
+
+  return true;
+}
+
+struct CManifestFile {
+  std::filesystem::path Path;
+  std::string RelativePath;
+};
+
+using CManifestBatch = std::vector<CManifestFile>;
+
+static bool walkDirectory(const std::filesystem::path &directory,
+                          const std::filesystem::path &relativePath,
+                          CManifestBatch &batch,
+                          BoundedQueue<CManifestBatch> &queue)
+{
+  // No exceptions here: worker threads must be joined
+  std::error_code ec;
+  for (std::filesystem::directory_iterator It(directory, ec), End; !ec && It != End; It.increment(ec)) {
+    const std::filesystem::path &path = It->path();
+    // Broken symbolic link will be reported by worker thread
+    std::error_code statusEc;
+    if (It->is_directory(statusEc)) {
+      if (!walkDirectory(path, relativePath / path.filename(), batch, queue))
+        return false;
+    } else {
+      batch.push_back(CManifestFile{path, (relativePath / path.filename()).string()});
+      if (batch.size() == HashBatchFiles) {
+        if (!queue.push(std::move(batch)))
+          return false;
+        batch.clear();
+      }
+    }
+  }
+
+  if (ec) {
+    fprintf(stderr, "ERROR: can't read directory %s\n", directory.string().c_str());
+    return false;
+  }
+
+  return true;
+}
+
+bool installManifestCreate(const std::filesystem::path &installDir, const std::filesystem::path &prefix, bool text, unsigned threads)
+{
+  // Directory walk in this thread, hashing in worker threads
+  unsigned threadsNum = std::max(threads, 1u);
+  BoundedQueue<CManifestBatch> queue(threadsNum * 4);
+  std::vector<CInstallManifestEntry> entries;
+  std::mutex entriesMutex;
+  std::atomic<bool> failed = false;
+
+  auto worker = [&]() {
+    CManifestBatch batch;
+    std::vector<std::filesystem::path> paths;
+    std::vector<CFileDigest> digests;
+    std::vector<CInstallManifestEntry> batchEntries;
+    while (queue.pop(batch)) {
+      paths.clear();
+      batchEntries.resize(batch.size());
+      for (size_t i = 0; i < batch.size(); i++) {
+        CInstallManifestEntry &entry = batchEntries[i];
+        entry.Path = std::move(batch[i].RelativePath);
+        // Stat before hashing: file changed while hashing will be re-hashed at next check
+        if (!fileStat(batch[i].Path, entry.Stat)) {
+          fprintf(stderr, "ERROR: can't stat file %s\n", batch[i].Path.string().c_str());
+          failed = true;
+          queue.close();
+          return;
+        }
+        entry.HasStat = true;
+        paths.push_back(std::move(batch[i].Path));
+      }
+
+      sha3FileDigestBatch(paths, digests);
+      for (size_t i = 0; i < batch.size(); i++) {
+        if (!digests[i].Ok) {
+          fprintf(stderr, "ERROR: can't read file %s\n", paths[i].string().c_str());
+          failed = true;
+          queue.close();
+          return;
+        }
+        memcpy(batchEntries[i].Digest, digests[i].Digest, sizeof(batchEntries[i].Digest));
+      }
+
+      std::unique_lock lock(entriesMutex);
+      std::move(batchEntries.begin(), batchEntries.end(), std::back_inserter(entries));
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (unsigned i = 0; i < threadsNum; i++)
+    workers.emplace_back(worker);
+  CManifestBatch batch;
+  if (!walkDirectory(installDir, "", batch, queue) || (!batch.empty() && !queue.push(std::move(batch))))
+    failed = true;
+  queue.close();
+  for (auto &thread: workers)
+    thread.join();
+
+  // Entries sorted by installManifestStore, so manifest not depends on hashing order
+  return !failed && installManifestStore(prefix, entries, text);
+}
+
+struct CVerifyState {
+  // Manifest index of first file for next sampled verification
+  size_t Cursor = 0;
+  // Files hashed in current pass
+  size_t Covered = 0;
+  unsigned Passes = 0;
+};
+
+static void verifyStateLoad(const std::filesystem::path &path, CVerifyState &state)
+{
+  std::ifstream file(path);
+  if (!file)
+    return;
+  std::stringstream content;
+  content << file.rdbuf();
+
+  std::string error;
+  auto json = json11::Json::parse(content.str(), error);
+  if (!error.empty())
+    return;
+  state.Cursor = json["cursor"].int_value();
+  state.Covered = json["covered"].int_value();
+  state.Passes = json["passes"].int_value();
+}
+
+static void verifyStateStore(const std::filesystem::path &path, const CVerifyState &state)
+{
+  json11::Json json = json11::Json::object {
+    {"cursor", static_cast<int>(state.Cursor)},
+    {"covered", static_cast<int>(state.Covered)},
+    {"passes", static_cast<int>(state.Passes)}
+  };
+
+  std::filesystem::path tmpPath = uniqueTempPath(path);
+  bool written;
+  {
+    std::ofstream file(tmpPath);
+    if (!file)
+      return;
+    file << json.dump();
+    written = static_cast<bool>(file);
+  }
+
+  std::error_code ec;
+  if (written)
+    std::filesystem::rename(tmpPath, path, ec);
+  if (!written || ec)
+    std::filesystem::remove(tmpPath, ec);
+}
+
+bool installManifestVerify(const std::filesystem::path &prefix,
+                           const std::filesystem::path &installDir,
+                           EVerifyMode mode,
+                           bool text,
+                           unsigned threads,
+                           CVerifyStats &stats)
+{
+  auto beginPt = std::chrono::steady_clock::now();
+  unsigned threadsNum = std::max(threads, 1u);
+  stats = CVerifyStats();
+
+  InstallManifest manifest;
+  if (!manifest.open(prefix))
+    return false;
+  size_t filesNum = manifest.size();
+  stats.FilesNum = filesNum;
+
+  // All modes: stat all files
+  std::vector<CFileStat> stat(filesNum);
+  std::vector<uint8_t> changed(filesNum, 0);
+  bool result = parallelFor(filesNum, threadsNum, [&](size_t index) -> bool {
+    std::filesystem::path path = installDir / manifest.path(index);
+    if (!fileStat(path, stat[index])) {
+      fprintf(stderr, "WARNING: can't read package file %s\n", path.string().c_str());
+      return false;
+    }
+    CFileStat expected;
+    if (manifest.stat(index, expected) && !sameStat(expected, stat[index])) {
+      if (expected.Size != stat[index].Size) {
+        fprintf(stderr, "WARNING: file %s corrupted, need reinstall\n", path.string().c_str());
+        return false;
+      }
+      changed[index] = 1;
+    }
+    return true;
+  });
+
+  if (!result) {
+    stats.Milliseconds = static_cast<unsigned>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - beginPt).count());
+    return false;
+  }
+
+  std::filesystem::path statePath = prefix / "verify.state";
+  CVerifyState state;
+  verifyStateLoad(statePath, state);
+  if (state.Cursor >= filesNum || state.Covered > filesNum)
+    state = CVerifyState();
+
+  // Files with changed stat data must be hashed in any mode, other files are optional
+  // Optional files are taken in manifest order starting from cursor, so each run checks next slice of files
+  std::vector<size_t> order;
+  std::vector<size_t> optional;
+  for (size_t i = 0; i < filesNum; i++) {
+    size_t index = (state.Cursor + i) % filesNum;
+    if (mode == EVerifyMode::Full || changed[index])
+      order.push_back(index);
+    else if (mode == EVerifyMode::Sampled)
+      optional.push_back(index);
+  }
+
+  // Largest files first: better balance between threads
+  std::sort(order.begin(), order.end(), [&stat](size_t l, size_t r) { return stat[l].Size > stat[r].Size; });
+
+  size_t mandatoryNum = order.size();
+  order.insert(order.end(), optional.begin(), optional.end());
+
+  // Split files into batches, mandatory and optional files are not mixed
+  std::vector<size_t> batchBegin;
+  {
+    uint64_t batchBytes = 0;
+    for (size_t i = 0; i < order.size(); i++) {
+      if (batchBegin.empty() || i == mandatoryNum || i - batchBegin.back() == HashBatchFiles || batchBytes >= HashBatchBytes) {
+        batchBegin.push_back(i);
+        batchBytes = 0;
+      }
+      batchBytes += stat[order[i]].Size;
+    }
+    batchBegin.push_back(order.size());
+  }
+
+  // Hashed files with changed or unknown stat data; their current stat data will be saved to manifest
+  std::vector<uint8_t> restamp(filesNum, 0);
+  auto deadline = beginPt + SampledBudget;
+  std::atomic<size_t> filesHashed = 0;
+  std::atomic<uint64_t> bytesHashed = 0;
+  std::atomic<bool> needRestamp = false;
+  // Each worker checks deadline itself, so hashed optional batches can have gaps
+  std::vector<uint8_t> batchHashed(batchBegin.size() - 1, 0);
+  result = parallelFor(batchBegin.size() - 1, threadsNum, [&](size_t batchIndex) -> bool {
+    size_t begin = batchBegin[batchIndex];
+    size_t end = batchBegin[batchIndex + 1];
+    if (begin >= mandatoryNum && std::chrono::steady_clock::now() >= deadline)
+      return true;
+
+    std::vector<std::filesystem::path> paths;
+    for (size_t index = begin; index < end; index++)
+      paths.push_back(installDir / manifest.path(order[index]));
+    std::vector<CFileDigest> digests;
+    sha3FileDigestBatch(paths, digests);
+
+    for (size_t index = begin; index < end; index++) {
+      size_t entryIndex = order[index];
+      const CFileDigest &digest = digests[index - begin];
+      const std::filesystem::path &path = paths[index - begin];
+      if (!digest.Ok) {
+        fprintf(stderr, "WARNING: can't read package file %s\n", path.string().c_str());
+        return false;
+      }
+      if (memcmp(digest.Digest, manifest.digest(entryIndex), sizeof(digest.Digest)) != 0) {
+        fprintf(stderr, "WARNING: file %s corrupted, need reinstall\n", path.string().c_str());
+        return false;
+      }
+
+      CFileStat expected;
+      if (changed[entryIndex] || !manifest.stat(entryIndex, expected)) {
+        restamp[entryIndex] = 1;
+        needRestamp = true;
+      }
+      bytesHashed.fetch_add(stat[entryIndex].Size, std::memory_order_relaxed);
+    }
+
+    filesHashed.fetch_add(end - begin, std::memory_order_relaxed);
+    batchHashed[batchIndex] = 1;
+    return true;
+  });
+
+  // Cursor advanced over longest run of hashed optional batches started from it
+  size_t optionalHashed = 0;
+  for (size_t batchIndex = 0; batchIndex + 1 < batchBegin.size(); batchIndex++) {
+    if (batchBegin[batchIndex] < mandatoryNum)
+      continue;
+    if (!batchHashed[batchIndex])
+      break;
+    optionalHashed += batchBegin[batchIndex + 1] - batchBegin[batchIndex];
+  }
+
+  if (result && mode != EVerifyMode::Fast && filesNum) {
+    if (mode == EVerifyMode::Full) {
+      state.Covered = 0;
+      state.Passes++;
+    } else {
+      // Files with changed stat data between old and new cursor are hashed too
+      size_t advance = filesNum;
+      if (optionalHashed < optional.size()) {
+        size_t cursor = order[mandatoryNum + optionalHashed];
+        advance = (cursor + filesNum - state.Cursor) % filesNum;
+        state.Cursor = cursor;
+      }
+      state.Covered += advance;
+      if (state.Covered >= filesNum) {
+        state.Covered -= filesNum;
+        state.Passes++;
+      }
+    }
+
+    verifyStateStore(statePath, state);
+  }
+
+  stats.Coverage = filesNum ? static_cast<double>(state.Covered) / filesNum : 1.0;
+  stats.Passes = state.Passes;
+  stats.FilesChanged = std::count(changed.begin(), changed.end(), 1);
+  stats.FilesHashed = filesHashed;
+  stats.BytesHashed = bytesHashed;
+
+  // Rewrite manifest: remember stat data of verified files, convert old text manifest
+  if (result && (needRestamp || manifest.convertedFromText())) {
+    std::vector<CInstallManifestEntry> entries;
+    manifest.entries(entries);
+    manifest.close();
+    for (size_t i = 0; i < filesNum; i++) {
+      if (restamp[i]) {
+        entries[i].HasStat = true;
+        entries[i].Stat = stat[i];
+      }
+    }
+    installManifestStore(prefix, entries, text);
+  }
+
+  stats.Milliseconds = static_cast<unsigned>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - beginPt).count());
+  return result;
+}
+
+bool installManifestTree(const std::filesystem::path &prefix, CMerkleNode &root)
+{
+  InstallManifest manifest;
+  if (!manifest.open(prefix))
+    return false;
+
+  root = CMerkleNode();
+  root.IsDirectory = true;
+  for (size_t i = 0, ie = manifest.size(); i < ie; i++) {
+    char hex[72] = {0};
+    bin2hexLowerCase(manifest.digest(i), hex, 32);
+    merkleAddFile(root, std::string(manifest.path(i)), hex);
+  }
+
+  merkleUpdate(root);
+  return true;
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "cxx-pm.h"
+#include "mappedfile.h"
+#include "merkle.h"
+#include "os.h"
+#include <stdint.h>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Manifest of installed package: relative paths of installed files, their SHA3 hashes and stat data
+// <prefix>/manifest.bin: binary format, used by all readers (see CBinaryManifestHeader)
+// <prefix>/manifest.txt: text format, written only with --text-manifest; older cxx-pm versions wrote only this file
+//   v1: <path>!<sha3>
+//   v2: header line and <path>!<sha3>!<size>!<mtime>!<inode>, or <path>!<sha3> if stat data not known
+// Files with unchanged stat data are not re-hashed
+
+// <prefix>/manifest.sfx: suffix index, manifest.bin entry indices sorted by reversed path (see CSuffixIndexHeader)
+
+// manifest.bin layout: header, entries sorted by path (memcmp order), path strings
+struct CBinaryManifestHeader {
+  char Magic[8];
+  uint32_t Version;
+  // Reserved, must be zero
+  uint32_t Flags;
+  uint64_t EntriesNum;
+  uint64_t StringsSize;
+};
+
+struct CBinaryManifestEntry {
+  // Offset in strings area
+  uint64_t PathOffset;
+  uint32_t PathSize;
+  uint32_t Flags;
+  uint8_t Digest[32];
+  // Valid if entry has BinaryManifestHasStat flag
+  uint64_t Size;
+  int64_t MTime;
+  uint64_t Inode;
+};
+
+// manifest.sfx layout: header, uint32_t entry indices
+// EntriesNum and StringsSize must match manifest.bin header, index ignored otherwise
+struct CSuffixIndexHeader {
+  char Magic[8];
+  uint32_t Version;
+  uint32_t Flags;
+  uint64_t EntriesNum;
+  uint64_t StringsSize;
+};
+
+struct CInstallManifestEntry {
+  std::string Path;
+  uint8_t Digest[32];
+  bool HasStat = false;
+  CFileStat Stat;
+};
+
+// Read-only view of binary manifest, memory mapped or converted from text manifest
+class InstallManifest {
+public:
+  bool open(const std::filesystem::path &prefix);
+  void close();
+
+  size_t size() const { return Header_ ? Header_->EntriesNum : 0; }
+  bool convertedFromText() const { return !Buffer_.empty(); }
+
+  std::string_view path(size_t index) const { return std::string_view(Strings_ + Entries_[index].PathOffset, Entries_[index].PathSize); }
+  const uint8_t *digest(size_t index) const { return Entries_[index].Digest; }
+  // Returns false if stat data not known
+  bool stat(size_t index, CFileStat &stat) const;
+  // Returns size() if not found
+  size_t find(std::string_view path) const;
+  // Search entries which paths ends with 'suffix', returns number of them and index of first one
+  // O(log(n) * suffix length) with suffix index, linear scan without it
+  size_t findSuffix(std::string_view suffix, size_t &index) const;
+
+  void entries(std::vector<CInstallManifestEntry> &out) const;
+
+private:
+  bool attach(const uint8_t *data, size_t size);
+
+private:
+  MappedFile File_;
+  MappedFile SuffixFile_;
+  std::vector<uint8_t> Buffer_;
+  // Suffix index, can be null
+  const uint32_t *SuffixIndex_ = nullptr;
+  const CBinaryManifestHeader *Header_ = nullptr;
+  const CBinaryManifestEntry *Entries_ = nullptr;
+  const char *Strings_ = nullptr;
+};
+
+struct CVerifyStats {
+  size_t FilesNum = 0;
+  size_t FilesChanged = 0;
+  size_t FilesHashed = 0;
+  uint64_t BytesHashed = 0;
+  unsigned Milliseconds = 0;
+  // Sampled verification progress: part of files hashed in current pass and number of complete passes
+  double Coverage = 0.0;
+  unsigned Passes = 0;
+};
+
+bool verifyModeFromString(const std::string &name, EVerifyMode &mode);
+const char *verifyModeToString(EVerifyMode mode);
+
+std::filesystem::path installManifestPath(const std::filesystem::path &prefix);
+
+// Write manifest.bin, manifest.sfx (and manifest.txt if 'text' is set), entries will be sorted
+bool installManifestStore(const std::filesystem::path &prefix, std::vector<CInstallManifestEntry> &entries, bool text);
+
+// Hash all files of directory by 'threads' threads and write manifest
+bool installManifestCreate(const std::filesystem::path &installDir, const std::filesystem::path &prefix, bool text, unsigned threads);
+
+// Returns false if manifest not exists or some file corrupted
+// All modes re-hash files with changed stat data
+// fast: only check that all files exist
+// sampled: also hash files until time budget expires, starting from cursor saved in state file by previous run,
+//          so every file hashed once per several runs
+// full: hash all files
+// Files checked and hashed in parallel by 'threads' threads
+// Stat data of changed files with correct hash are written to manifest, FilesChanged is a number of such files
+// Old text-only manifest converted to binary here
+bool installManifestVerify(const std::filesystem::path &prefix,
+                           const std::filesystem::path &installDir,
+                           EVerifyMode mode,
+                           bool text,
+                           unsigned threads,
+                           CVerifyStats &stats);
+
+// Merkle tree of installed files built from manifest, no files hashed
+bool installManifestTree(const std::filesystem::path &prefix, CMerkleNode &root);
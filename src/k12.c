@@ -0,0 +1,214 @@
+#include "k12.h"
+#include "sha3.h"
+#include <string.h>
+
+#define TURBOSHAKE128_RATE 168
+
+void turboShake128Init(CCtxTurboShake128 *ctx)
+{
+  memset(ctx->State, 0, sizeof(ctx->State));
+  ctx->BufferSize = 0;
+}
+
+void turboShake128Update(CCtxTurboShake128 *ctx, const void *data, size_t size)
+{
+  const uint8_t *p = (const uint8_t*)data;
+  uint8_t *state8 = (uint8_t*)ctx->State;
+  while (size) {
+    size_t copySize = TURBOSHAKE128_RATE - ctx->BufferSize;
+    if (copySize > size)
+      copySize = size;
+    if (ctx->BufferSize == 0 && copySize == TURBOSHAKE128_RATE) {
+      for (unsigned i = 0; i < TURBOSHAKE128_RATE / 8; i++) {
+        uint64_t word;
+        memcpy(&word, p + i*8, sizeof(word));
+        ctx->State[i] ^= word;
+      }
+    } else {
+      for (size_t i = 0; i < copySize; i++)
+        state8[ctx->BufferSize + i] ^= p[i];
+    }
+    ctx->BufferSize += (uint32_t)copySize;
+    p += copySize;
+    size -= copySize;
+    if (ctx->BufferSize == TURBOSHAKE128_RATE) {
+      sha3llTransform12(ctx->State);
+      ctx->BufferSize = 0;
+    }
+  }
+}
+
+void turboShake128Final(CCtxTurboShake128 *ctx, uint8_t domain, uint8_t *out, size_t outSize)
+{
+  uint8_t *state8 = (uint8_t*)ctx->State;
+  state8[ctx->BufferSize] ^= domain;
+  state8[TURBOSHAKE128_RATE - 1] ^= 0x80;
+  sha3llTransform12(ctx->State);
+  while (outSize) {
+    size_t copySize = outSize < TURBOSHAKE128_RATE ? outSize : TURBOSHAKE128_RATE;
+    memcpy(out, state8, copySize);
+    out += copySize;
+    outSize -= copySize;
+    if (outSize)
+      sha3llTransform12(ctx->State);
+  }
+}
+
+// Big endian without leading zeroes, then number of bytes
+static size_t lengthEncode(size_t value, uint8_t out[9])
+{
+  size_t size = 0;
+  for (size_t v = value; v; v >>= 8)
+    size++;
+  for (size_t i = 0; i < size; i++)
+    out[i] = (uint8_t)(value >> (8 * (size - 1 - i)));
+  out[size] = (uint8_t)size;
+  return size + 1;
+}
+
+size_t k12CustomSuffix(const void *custom, size_t customSize, uint8_t *out, size_t outSize)
+{
+  uint8_t encoded[9];
+  size_t encodedSize = lengthEncode(customSize, encoded);
+  if (customSize + encodedSize > outSize)
+    return 0;
+  if (customSize)
+    memcpy(out, custom, customSize);
+  memcpy(out + customSize, encoded, encodedSize);
+  return customSize + encodedSize;
+}
+
+void k12Leaf(const void *data, size_t size, const void *suffix, size_t suffixSize, uint8_t cv[K12_CV_SIZE])
+{
+  CCtxTurboShake128 ctx;
+  turboShake128Init(&ctx);
+  turboShake128Update(&ctx, data, size);
+  turboShake128Update(&ctx, suffix, suffixSize);
+  turboShake128Final(&ctx, 0x0B, cv, K12_CV_SIZE);
+}
+
+void k12Final(const void *first, size_t firstSize,
+              const void *firstSuffix, size_t firstSuffixSize,
+              const uint8_t *cv, size_t cvNum,
+              uint8_t *out, size_t outSize)
+{
+  static const uint8_t chainingMarker[8] = {0x03, 0, 0, 0, 0, 0, 0, 0};
+  static const uint8_t finalMarker[2] = {0xFF, 0xFF};
+  CCtxTurboShake128 ctx;
+  turboShake128Init(&ctx);
+  turboShake128Update(&ctx, first, firstSize);
+  turboShake128Update(&ctx, firstSuffix, firstSuffixSize);
+  if (cvNum == 0) {
+    turboShake128Final(&ctx, 0x07, out, outSize);
+    return;
+  }
+
+  uint8_t encoded[9];
+  size_t encodedSize = lengthEncode(cvNum, encoded);
+  turboShake128Update(&ctx, chainingMarker, sizeof(chainingMarker));
+  turboShake128Update(&ctx, cv, cvNum * K12_CV_SIZE);
+  turboShake128Update(&ctx, encoded, encodedSize);
+  turboShake128Update(&ctx, finalMarker, sizeof(finalMarker));
+  turboShake128Final(&ctx, 0x06, out, outSize);
+}
+
+void k12(const void *data, size_t size, const void *custom, size_t customSize, uint8_t *out, size_t outSize)
+{
+  // S = M || C || length_encode(|C|), custom string of any size processed as stream
+  const uint8_t *m = (const uint8_t*)data;
+  const uint8_t *c = (const uint8_t*)custom;
+  uint8_t encoded[9];
+  size_t encodedSize = lengthEncode(customSize, encoded);
+  size_t totalSize = size + customSize + encodedSize;
+
+  // Copy part of S from offset to buffer
+  uint8_t chunk[K12_CHUNK_SIZE];
+  uint8_t cv[K12_CV_SIZE];
+  CCtxTurboShake128 final;
+  size_t cvNum = 0;
+  for (size_t offset = 0; offset < totalSize; offset += K12_CHUNK_SIZE) {
+    size_t chunkSize = totalSize - offset < K12_CHUNK_SIZE ? totalSize - offset : K12_CHUNK_SIZE;
+    for (size_t i = 0; i < chunkSize; i++) {
+      size_t pos = offset + i;
+      chunk[i] = pos < size ? m[pos] : pos < size + customSize ? c[pos - size] : encoded[pos - size - customSize];
+    }
+
+    if (offset == 0) {
+      turboShake128Init(&final);
+      turboShake128Update(&final, chunk, chunkSize);
+      if (totalSize <= K12_CHUNK_SIZE) {
+        turboShake128Final(&final, 0x07, out, outSize);
+        return;
+      }
+      static const uint8_t chainingMarker[8] = {0x03, 0, 0, 0, 0, 0, 0, 0};
+      turboShake128Update(&final, chainingMarker, sizeof(chainingMarker));
+    } else {
+      k12Leaf(chunk, chunkSize, 0, 0, cv);
+      turboShake128Update(&final, cv, sizeof(cv));
+      cvNum++;
+    }
+  }
+
+  static const uint8_t finalMarker[2] = {0xFF, 0xFF};
+  encodedSize = lengthEncode(cvNum, encoded);
+  turboShake128Update(&final, encoded, encodedSize);
+  turboShake128Update(&final, finalMarker, sizeof(finalMarker));
+  turboShake128Final(&final, 0x06, out, outSize);
+}
+
+void k12StreamInit(CCtxK12 *ctx)
+{
+  turboShake128Init(&ctx->Final);
+  ctx->Size = 0;
+  ctx->CvNum = 0;
+}
+
+static void k12StreamLeafFinish(CCtxK12 *ctx)
+{
+  uint8_t cv[K12_CV_SIZE];
+  turboShake128Final(&ctx->Leaf, 0x0B, cv, sizeof(cv));
+  turboShake128Update(&ctx->Final, cv, sizeof(cv));
+  ctx->CvNum++;
+}
+
+void k12StreamUpdate(CCtxK12 *ctx, const void *data, size_t size)
+{
+  static const uint8_t chainingMarker[8] = {0x03, 0, 0, 0, 0, 0, 0, 0};
+  const uint8_t *p = (const uint8_t*)data;
+  while (size) {
+    size_t chunkOffset = (size_t)(ctx->Size % K12_CHUNK_SIZE);
+    if (ctx->Size >= K12_CHUNK_SIZE && chunkOffset == 0) {
+      // Previous chunk is complete and not last
+      if (ctx->Size == K12_CHUNK_SIZE)
+        turboShake128Update(&ctx->Final, chainingMarker, sizeof(chainingMarker));
+      else
+        k12StreamLeafFinish(ctx);
+      turboShake128Init(&ctx->Leaf);
+    }
+
+    size_t n = K12_CHUNK_SIZE - chunkOffset < size ? K12_CHUNK_SIZE - chunkOffset : size;
+    turboShake128Update(ctx->Size < K12_CHUNK_SIZE ? &ctx->Final : &ctx->Leaf, p, n);
+    ctx->Size += n;
+    p += n;
+    size -= n;
+  }
+}
+
+void k12StreamFinal(CCtxK12 *ctx, uint8_t *out, size_t outSize)
+{
+  // S = M || length_encode(0)
+  static const uint8_t emptyCustom = 0;
+  static const uint8_t finalMarker[2] = {0xFF, 0xFF};
+  k12StreamUpdate(ctx, &emptyCustom, 1);
+  if (ctx->Size <= K12_CHUNK_SIZE) {
+    turboShake128Final(&ctx->Final, 0x07, out, outSize);
+    return;
+  }
+
+  k12StreamLeafFinish(ctx);
+  uint8_t encoded[9];
+  size_t encodedSize = lengthEncode((size_t)ctx->CvNum, encoded);
+  turboShake128Update(&ctx->Final, encoded, encodedSize);
+  turboShake128Update(&ctx->Final, finalMarker, sizeof(finalMarker));
+  turboShake128Final(&ctx->Final, 0x06, out, outSize);
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// KangarooTwelve (KT128, RFC 9861): tree hash over Keccak-p[1600, 12]
+// Message split to 8192 byte chunks, all chunks except first can be hashed independently (k12Leaf)
+#define K12_CHUNK_SIZE 8192
+#define K12_CV_SIZE 32
+
+// TurboSHAKE128
+typedef struct CCtxTurboShake128 {
+  uint64_t State[25];
+  uint32_t BufferSize;
+} CCtxTurboShake128;
+
+void turboShake128Init(CCtxTurboShake128 *ctx);
+void turboShake128Update(CCtxTurboShake128 *ctx, const void *data, size_t size);
+void turboShake128Final(CCtxTurboShake128 *ctx, uint8_t domain, uint8_t *out, size_t outSize);
+
+// Chaining value of chunk (chunk with custom string suffix for last chunk)
+void k12Leaf(const void *data, size_t size, const void *suffix, size_t suffixSize, uint8_t cv[K12_CV_SIZE]);
+// Final node: first chunk and chaining values of other chunks (cvNum can be zero for single chunk message)
+void k12Final(const void *first, size_t firstSize,
+              const void *firstSuffix, size_t firstSuffixSize,
+              const uint8_t *cv, size_t cvNum,
+              uint8_t *out, size_t outSize);
+
+// Custom string encoding appended to message: C || length_encode(|C|)
+size_t k12CustomSuffix(const void *custom, size_t customSize, uint8_t *out, size_t outSize);
+
+// Sequential KT128
+void k12(const void *data, size_t size, const void *custom, size_t customSize, uint8_t *out, size_t outSize);
+
+// Incremental KT128 with empty custom string, for data arriving in pieces of any size
+// First chunk and chaining values absorbed by final node as soon as they are known, no message buffering
+typedef struct CCtxK12 {
+  CCtxTurboShake128 Final;
+  CCtxTurboShake128 Leaf;
+  uint64_t Size;
+  uint64_t CvNum;
+} CCtxK12;
+
+void k12StreamInit(CCtxK12 *ctx);
+void k12StreamUpdate(CCtxK12 *ctx, const void *data, size_t size);
+void k12StreamFinal(CCtxK12 *ctx, uint8_t *out, size_t outSize);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,61 @@
+#include "k12Tools.h"
+#include "hashcache.h"
+#include "mappedfile.h"
+#include "parallel.h"
+#include "strExtras.h"
+extern "C" {
+#include "k12.h"
+}
+#include <algorithm>
+#include <vector>
+
+// Chunks hashed by one task
+static constexpr size_t LeavesPerTask = 64;
+
+bool k12FileDigest(const std::filesystem::path &path, uint8_t digest[32], unsigned threads)
+{
+  MappedFile file;
+  if (!file.open(path))
+    return false;
+  file.adviseSequential();
+
+  // S = M || C || length_encode(|C|), for empty C suffix is single zero byte
+  uint8_t suffix[1];
+  size_t suffixSize = k12CustomSuffix(nullptr, 0, suffix, sizeof(suffix));
+  const uint8_t *data = file.data();
+  size_t size = file.size();
+  if (size + suffixSize <= K12_CHUNK_SIZE) {
+    k12Final(data, size, suffix, suffixSize, nullptr, 0, digest, 32);
+    return true;
+  }
+
+  // Suffix always in last chunk: first chunk is full
+  size_t leavesNum = (size + suffixSize - 1) / K12_CHUNK_SIZE;
+  std::vector<uint8_t> cv(leavesNum * K12_CV_SIZE);
+  size_t tasksNum = (leavesNum + LeavesPerTask - 1) / LeavesPerTask;
+  parallelFor(tasksNum, std::max(threads, 1u), [&](size_t task) -> bool {
+    size_t last = std::min((task + 1) * LeavesPerTask, leavesNum);
+    for (size_t leaf = task * LeavesPerTask; leaf < last; leaf++) {
+      size_t offset = (leaf + 1) * K12_CHUNK_SIZE;
+      size_t chunkSize = std::min(size - offset, static_cast<size_t>(K12_CHUNK_SIZE));
+      bool isLast = leaf + 1 == leavesNum;
+      k12Leaf(data + offset, chunkSize, suffix, isLast ? suffixSize : 0, &cv[leaf * K12_CV_SIZE]);
+    }
+    return true;
+  });
+
+  k12Final(data, K12_CHUNK_SIZE, nullptr, 0, cv.data(), leavesNum, digest, 32);
+  return true;
+}
+
+std::string k12FileHash(const std::filesystem::path &path, unsigned threads)
+{
+  return hashCacheFileHash(path, "k12", [threads](const std::filesystem::path &path) -> std::string {
+    uint8_t hash[32];
+    char hex[72] = {0};
+    if (!k12FileDigest(path, hash, threads))
+      return std::string();
+    bin2hexLowerCase(hash, hex, 32);
+    return hex;
+  });
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdint.h>
+#include <filesystem>
+#include <string>
+
+// KangarooTwelve hash of file (empty custom string), chunks hashed by 'threads' worker threads
+bool k12FileDigest(const std::filesystem::path &path, uint8_t digest[32], unsigned threads);
+std::string k12FileHash(const std::filesystem::path &path, unsigned threads);
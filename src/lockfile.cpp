@@ -0,0 +1,210 @@
+#include "lockfile.h"
+#include "filelock.h"
+#include "installmanifest.h"
+#include "os.h"
+#include "sha3Tools.h"
+#include "json/json11.hpp"
+#include <stdlib.h>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+static const int LockFormatVersion = 1;
+
+static bool readFile(const std::filesystem::path &path, std::string &content)
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    return false;
+  std::stringstream stream;
+  stream << file.rdbuf();
+  content = stream.str();
+  return true;
+}
+
+std::string fileStamp(const std::filesystem::path &path)
+{
+  std::error_code ec;
+  auto status = std::filesystem::status(path, ec);
+  if (ec || !std::filesystem::exists(status))
+    return std::string();
+  auto mtime = std::filesystem::last_write_time(path, ec);
+  if (ec)
+    return std::string();
+
+  std::string stamp;
+  if (std::filesystem::is_directory(status)) {
+    stamp = "dir";
+  } else {
+    auto size = std::filesystem::file_size(path, ec);
+    if (ec)
+      return std::string();
+    stamp = std::to_string(size);
+  }
+  stamp.push_back(':');
+  stamp.append(std::to_string(mtime.time_since_epoch().count()));
+  return stamp;
+}
+
+std::string lockFileFingerprint(const std::filesystem::path &self, const std::vector<std::string> &arguments)
+{
+  std::string data = "format=" + std::to_string(LockFormatVersion);
+  data.append("\nself=");
+  data.append(self.string());
+  data.push_back(' ');
+  data.append(fileStamp(self));
+  data.append("\nhome=");
+  data.append(userHomeDir().string());
+  // Compilers and tools without full path resolved using PATH
+  const char *path = getenv("PATH");
+  data.append("\npath=");
+  data.append(path ? path : "");
+  for (const auto &arg: arguments) {
+    data.push_back('\n');
+    data.append(arg);
+  }
+  return sha3StringHash(data);
+}
+
+static bool writeLockJson(const std::filesystem::path &path, const json11::Json &json)
+{
+  // Parallel runs can share lock file: each writes own temporary file, last rename wins
+  std::filesystem::path tmpPath = uniqueTempPath(path);
+  std::error_code ec;
+  {
+    std::ofstream file(tmpPath);
+    if (!file) {
+      fprintf(stderr, "ERROR: can't write lock file %s\n", tmpPath.string().c_str());
+      return false;
+    }
+    file << json.dump();
+    if (!file) {
+      fprintf(stderr, "ERROR: can't write lock file %s\n", tmpPath.string().c_str());
+      file.close();
+      std::filesystem::remove(tmpPath, ec);
+      return false;
+    }
+  }
+
+  std::filesystem::rename(tmpPath, path, ec);
+  if (ec) {
+    fprintf(stderr, "ERROR: can't write lock file %s\n", path.string().c_str());
+    std::filesystem::remove(tmpPath, ec);
+    return false;
+  }
+
+  return true;
+}
+
+bool lockFileStore(const std::filesystem::path &path, const CLockFile &lock)
+{
+  json11::Json::array inputs;
+  for (const auto &[inputPath, stamp]: lock.Inputs)
+    inputs.push_back(json11::Json::object {{"path", inputPath.string()}, {"stamp", stamp}});
+
+  json11::Json::array packages;
+  for (const auto &package: lock.Packages) {
+    packages.push_back(json11::Json::object {
+      {"name", package.Name},
+      {"version", package.Version},
+      {"build_type", package.BuildType},
+      {"build_file", package.BuildFile.string()},
+      {"prefix", package.Prefix.string()},
+      {"manifest", package.Manifest}
+    });
+  }
+
+  json11::Json json = json11::Json::object {
+    {"format", LockFormatVersion},
+    {"fingerprint", lock.Fingerprint},
+    {"inputs", inputs},
+    {"packages", packages},
+    {"export_path", lock.ExportPath.string()},
+    {"export_content", lock.ExportContent}
+  };
+
+  return writeLockJson(path, json);
+}
+
+bool lockFileCheck(const std::filesystem::path &path, const std::string &fingerprint, EVerifyMode verifyMode, bool textManifest, bool verbose)
+{
+  if (verifyMode == EVerifyMode::Full) {
+    printf("Lock file %s ignored: full verification requested\n", path.string().c_str());
+    return false;
+  }
+
+  std::string content;
+  if (!readFile(path, content))
+    return false;
+
+  std::string error;
+  auto json = json11::Json::parse(content, error);
+  if (!error.empty() || json["format"].int_value() != LockFormatVersion)
+    return false;
+
+  if (json["fingerprint"].string_value() != fingerprint) {
+    if (verbose)
+      printf("Lock file %s: command line or environment changed\n", path.string().c_str());
+    return false;
+  }
+
+  for (const auto &input: json["inputs"].array_items()) {
+    if (fileStamp(input["path"].string_value()) != input["stamp"].string_value()) {
+      if (verbose)
+        printf("Lock file %s: %s changed\n", path.string().c_str(), input["path"].string_value().c_str());
+      return false;
+    }
+  }
+
+  // Installed packages: manifest must be the same as after install and installed files must match it
+  json11::Json::array packages;
+  bool manifestsUpdated = false;
+  for (const auto &package: json["packages"].array_items()) {
+    std::filesystem::path prefix = package["prefix"].string_value();
+    std::filesystem::path manifestPath = installManifestPath(prefix);
+    // Verify can rewrite manifest and verify state: other process can install same prefix right now
+    FileLock prefixLock;
+    if (!prefixLock.lock(lockPathFor(prefix)))
+      return false;
+    CVerifyStats stats;
+    if (!std::filesystem::exists(manifestPath) ||
+        sha3FileHash(manifestPath) != package["manifest"].string_value() ||
+        !installManifestVerify(prefix, prefix / "install", verifyMode, textManifest, std::thread::hardware_concurrency(), stats)) {
+      if (verbose)
+        printf("Lock file %s: package %s not installed or changed\n", path.string().c_str(), package["name"].string_value().c_str());
+      return false;
+    }
+
+    // Stat data of touched files updated in manifest
+    json11::Json::object item = package.object_items();
+    if (stats.FilesChanged) {
+      item["manifest"] = sha3FileHash(manifestPath);
+      manifestsUpdated = true;
+    }
+    packages.push_back(item);
+  }
+
+  if (manifestsUpdated) {
+    json11::Json::object root = json.object_items();
+    root["packages"] = packages;
+    if (!writeLockJson(path, root))
+      return false;
+  }
+
+  std::filesystem::path exportPath = json["export_path"].string_value();
+  if (!exportPath.empty()) {
+    const std::string &exportContent = json["export_content"].string_value();
+    std::string currentContent;
+    if (!readFile(exportPath, currentContent) || currentContent != exportContent) {
+      std::ofstream file(exportPath, std::ios::binary);
+      file << exportContent;
+      if (!file) {
+        fprintf(stderr, "ERROR: can't write %s\n", exportPath.string().c_str());
+        return false;
+      }
+    }
+  }
+
+  printf("Lock file %s is up to date, %zu packages installed\n", path.string().c_str(), json["packages"].array_items().size());
+  return true;
+}
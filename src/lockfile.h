@@ -0,0 +1,41 @@
+#pragma once
+
+#include "cxx-pm.h"
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+// Lock file (--lock): fully resolved install graph of previous successful run
+// If command line, toolchain and package files are not changed, install can be skipped entirely
+
+struct CLockedPackage {
+  std::string Name;
+  std::string Version;
+  std::string BuildType;
+  std::filesystem::path BuildFile;
+  std::filesystem::path Prefix;
+  // SHA3 of prefix manifest
+  std::string Manifest;
+};
+
+struct CLockFile {
+  // Hash of command line options, environment and cxx-pm executable
+  std::string Fingerprint;
+  // Files and directories used for resolving (compilers, build files, package directories) and their stamps
+  std::map<std::filesystem::path, std::string> Inputs;
+  std::vector<CLockedPackage> Packages;
+  std::filesystem::path ExportPath;
+  std::string ExportContent;
+};
+
+// Size and modification time of file or directory, empty string if not exists
+std::string fileStamp(const std::filesystem::path &path);
+
+std::string lockFileFingerprint(const std::filesystem::path &self, const std::vector<std::string> &arguments);
+
+bool lockFileStore(const std::filesystem::path &path, const CLockFile &lock);
+
+// Returns true if lock file matches current state; restores export file if needed
+// Installed files verified with verifyMode (fast or sampled); full verification always ignores lock file
+bool lockFileCheck(const std::filesystem::path &path, const std::string &fingerprint, EVerifyMode verifyMode, bool textManifest, bool verbose);
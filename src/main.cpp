@@ -7,10 +7,24 @@
 #include "os.h"
 #include "package.h"
 #include "sha3Tools.h"
+#include "k12Tools.h"
 #include "ecdsa.h"
 #include "manifest.h"
 #include "version.h"
 #include "msys2db.h"
+#include "httpdownload.h"
+#include "parallel.h"
+#include "filelock.h"
+#include "metadata.h"
+#include "repoindex.h"
+#include "lockfile.h"
+#include "merkle.h"
+#include "installmanifest.h"
+#include "hashcache.h"
+extern "C" {
+#include "sha3.h"
+#include "k12.h"
+}
 
 #ifdef WIN32
 #include <Windows.h>
@@ -27,6 +41,8 @@
 #include <fstream>
 #include <map>
 #include <set>
+#include <sstream>
+#include <thread>
 #include <vector>
 
 
@@ -56,7 +72,13 @@ enum CmdLineOptsTy {
   clOptVersion,
   clOptUpdate,
   clOptRepository,
-  clOptInstallMsys2
+  clOptInstallMsys2,
+  clOptJobs,
+  clOptLock,
+  clOptVerify,
+  clOptTextManifest,
+  clOptDiffPrefix,
+  clOptNoHashCache
 };
 
 enum EModeTy {
@@ -65,7 +87,8 @@ enum EModeTy {
   ESearchPath,
   EInstall,
   EUpdate,
-  EInstallMsys2
+  EInstallMsys2,
+  EDiffPrefix
 };
 
 static option cmdLineOpts[] = {
@@ -92,8 +115,14 @@ static option cmdLineOpts[] = {
   {"update", no_argument, nullptr, clOptUpdate},
   {"repository", required_argument, nullptr, clOptRepository},
   {"install-msys2", optional_argument, nullptr, clOptInstallMsys2},
+  {"diff-prefix", required_argument, nullptr, clOptDiffPrefix},
   // extra parameters
   {"package-extra-dir", required_argument, nullptr, clOptPackageExtraDirectory},
+  {"jobs", required_argument, nullptr, clOptJobs},
+  {"lock", required_argument, nullptr, clOptLock},
+  {"verify", required_argument, nullptr, clOptVerify},
+  {"text-manifest", no_argument, nullptr, clOptTextManifest},
+  {"no-hash-cache", no_argument, nullptr, clOptNoHashCache},
   // arguments
   {"file", required_argument, nullptr, clOptFile},
   // other
@@ -108,69 +137,14 @@ struct CContext {
   ToolsArray Tools;
 };
 
-bool loadVariables(const std::filesystem::path &path, const std::vector<std::string> &names, std::vector<std::string> &variables)
-{
-  std::string capturedOut;
-  std::string capturedErr;
-  std::filesystem::path fullPath;
-  std::string args;
-
-  args = "set -e; source ";
-  args.append(pathConvert(path, EPathType::Posix).string());
-  args.append("; ");
-  for (const auto &v: names) {
-    args.append("echo \"$");
-    args.append(v);
-    args.append("\"@; ");
-  }
-
-  if (!run(path.parent_path(), "bash", {"-c", args}, {}, fullPath, capturedOut, capturedErr, true)) {
-    if (!fullPath.empty())
-      fprintf(stderr, "%s\n", capturedErr.c_str());
-    return false;
-  }
-
-  StringSplitter splitter(capturedOut, "\r\n");
-  while (splitter.next()) {
-    auto v = splitter.get();
-    if (v.back() != '@')
-      continue;
-    variables.emplace_back(v.begin(), v.end()-1);
-  }
-
-  return names.size() == variables.size();
-}
-
-bool loadSingleVariable(const std::filesystem::path &path, const std::string &name, std::string &variable)
-{
-  std::string capturedOut;
-  std::string capturedErr;
-  std::filesystem::path fullPath;
-  std::string args;
-
-  args = "set -e; source ";
-  args.append(pathConvert(path, EPathType::Posix).string());
-  args.append("; echo \"$");
-  args.append(name);
-  args.append("\"@;");
-
-  if (!run(path.parent_path(), "bash", {"-c", args}, {}, fullPath, capturedOut, capturedErr, true)) {
-    if (!fullPath.empty())
-      fprintf(stderr, "%s\n", capturedErr.c_str());
-    return false;
-  }
-
-  StringSplitter splitter(capturedOut, "\r\n");
-  while (splitter.next()) {
-    auto v = splitter.get();
-    if (!v.empty() && v.back() == '@') {
-      variable = std::string(v.begin(), v.end()-1);
-      return true;
-    }
-  }
-
-  return false;
-}
+struct CInstallNode {
+  CPackage Package;
+  std::string BuildType;
+  // Binary dependencies installed into package prefix
+  std::vector<CInstallNode> BinaryDepends;
+  // Indices of graph nodes which must be installed before this one
+  std::vector<size_t> Depends;
+};
 
 std::vector<std::string> collectAvailableVersions(const CPackage &package)
 {
@@ -189,7 +163,12 @@ std::vector<std::string> collectAvailableVersions(const CPackage &package)
     }
   };
 
-  scanDir(package.Path);
+  if (package.Indexed) {
+    for (const auto &indexed : package.IndexedVersions)
+      versions.push_back(indexed.Version);
+  } else {
+    scanDir(package.Path);
+  }
   for (const auto &extraPath : package.ExtraPath)
     scanDir(extraPath);
 
@@ -202,7 +181,9 @@ bool packageQueryVersion(CPackage &package, const std::string &requestedVersion,
 
   // Load default version from meta build
   if (version.empty() || version == "default") {
-    if (!loadSingleVariable(package.Path / "meta.build", "DEFAULT_VERSION", version)) {
+    if (package.Indexed) {
+      version = package.IndexedDefaultVersion;
+    } else if (!loadSingleVariable(package.Path / "meta.build", "DEFAULT_VERSION", version)) {
       fprintf(stderr, "ERROR: can't load DEFAULT_VERSION from %s\n", (package.Path / "meta.build").string().c_str());
       return false;
     }
@@ -270,17 +251,13 @@ bool inspectPackage(const CContext &context, CPackage &package, const std::strin
     return false;
   }
 
-  // Query package compilers
-  std::vector<std::string> variables;
-  std::string packageTypeVariable;
-  std::string compilersVariable;
-  if (!loadVariables(package.BuildFile, { "PACKAGE_TYPE", "LANGS" }, variables)) {
-    fprintf(stderr, "ERROR: can't load PACKAGE_TYPE, LANGS variables from %s\n", package.BuildFile.string().c_str());
+  // Load all package variables at once
+  std::string hostPrefix = context.SystemInfo.HostSystemName + "_" + context.SystemInfo.HostSystemProcessor + "_";
+  if (!loadPackageMetadata(package.BuildFile, hostPrefix, package.Metadata))
     return false;
-  }
 
-  packageTypeVariable = variables[0];
-  compilersVariable = variables[1];
+  const std::string &packageTypeVariable = package.Metadata.PackageType;
+  const std::string &compilersVariable = package.Metadata.Langs;
 
   // Check package type
   if (packageTypeVariable.empty()) {
@@ -322,59 +299,20 @@ void updatePackagePrefix(const CContext &context, CPackage &package, const std::
   package.Prefix = packagePrefix(context.GlobalSettings.HomeDir, package, context.Compilers, context.SystemInfo, buildType, verbose);
 }
 
-void createManifestForDirectory(FILE *hLog, const std::filesystem::path &directory, const std::filesystem::path &relativePath)
-{
-  for(const auto &element: std::filesystem::directory_iterator{directory}) {
-    if (element.is_directory()) {
-      createManifestForDirectory(hLog, element, relativePath / element.path().filename());
-    } else {
-      std::string hash = sha3FileHash(element);
-      fprintf(hLog, "%s!%s\n", (relativePath / element.path().filename()).string().c_str(), hash.c_str());
-    }
-  }
-}
-
 bool downloadPackageFiles(const CContext& context,
                           const CPackage& package,
                           const std::filesystem::path &sourceDir,
                           const std::filesystem::path &binaryInstallDir)
 {
-  std::string type;
-  std::string url;
-  std::string sha3;
-  std::string tag;
-  std::string commit;
-  std::filesystem::path destination;
-  if (!package.IsBinary) {
-    std::vector<std::string> variables;
-    if (!loadVariables(package.BuildFile, { "TYPE", "URL", "SHA3", "TAG", "COMMIT" }, variables)) {
-      fprintf(stderr, "ERROR, can't load TYPE, URL, SHA3, TAG, COMMIT from %s\n", package.BuildFile.string().c_str());
-      return false;
-    }
-
-    type = std::move(variables[0]);
-    url = std::move(variables[1]);
-    sha3 = std::move(variables[2]);
-    tag = std::move(variables[3]);
-    commit = std::move(variables[4]);
-    destination = sourceDir;
-  } else {
-    std::vector<std::string> variableNames;
-    std::vector<std::string> variables;
-    std::string namePrefix = context.SystemInfo.HostSystemName + "_" + context.SystemInfo.HostSystemProcessor + "_";
-    for (const auto &name : { "TYPE", "URL", "SHA3", "TAG", "COMMIT" })
-      variableNames.emplace_back(namePrefix + name);
-
-    if (!loadVariables(package.BuildFile, variableNames, variables)) {
-      fprintf(stderr, "ERROR, can't load TYPE, URL, SHA3, TAG, COMMIT from %s\n", package.BuildFile.string().c_str());
-      return false;
-    }
-
-    type = std::move(variables[0]);
-    url = std::move(variables[1]);
-    sha3 = std::move(variables[2]);
-    destination = binaryInstallDir;
-  }
+  const CPackageMetadata &metadata = package.Metadata;
+  const std::string &type = package.IsBinary ? metadata.HostType : metadata.Type;
+  const std::string &url = package.IsBinary ? metadata.HostUrl : metadata.Url;
+  const std::string &sha3 = package.IsBinary ? metadata.HostSha3 : metadata.Sha3;
+  const std::string &k12 = package.IsBinary ? metadata.HostK12 : metadata.K12;
+  const std::string &size = package.IsBinary ? metadata.HostSize : metadata.Size;
+  const std::string &tag = package.IsBinary ? metadata.HostTag : metadata.Tag;
+  const std::string &commit = package.IsBinary ? metadata.HostCommit : metadata.Commit;
+  const std::filesystem::path &destination = package.IsBinary ? binaryInstallDir : sourceDir;
 
   printf("Downloading package %s:%s\n", package.Name.c_str(), package.Version.c_str());
   if (type == "archive") {
@@ -382,11 +320,30 @@ bool downloadPackageFiles(const CContext& context,
       fprintf(stderr, "ERROR: URL must be specified for 'archive'\n");
       return false;
     }
-    if (sha3.size() != 64) {
-      fprintf(stderr, "ERROR: SHA3 256 bit hash must be specified for 'archive'\n");
+    if (sha3.size() != 64 && k12.size() != 64) {
+      fprintf(stderr, "ERROR: SHA3 or K12 256 bit hash must be specified for 'archive'\n");
       return false;
     }
 
+    // Without size hash mismatch is known only after whole archive received
+    uint64_t expectedSize = 0;
+    if (!size.empty()) {
+      char *end = nullptr;
+      expectedSize = strtoull(size.c_str(), &end, 10);
+      if (*end != 0 || expectedSize == 0) {
+        fprintf(stderr, "ERROR: invalid archive size: %s\n", size.c_str());
+        return false;
+      }
+    }
+
+    // KangarooTwelve hashes chunks of large archive by all cores, preferred if specified
+    const char *hashName = k12.empty() ? "SHA3" : "K12";
+    const std::string &expectedHash = k12.empty() ? sha3 : k12;
+    unsigned hashThreads = context.GlobalSettings.HashThreads;
+    auto archiveHash = [&k12, hashThreads](const std::filesystem::path &path) {
+      return k12.empty() ? sha3FileHash(path) : k12FileHash(path, hashThreads);
+    };
+
     // get file name from url
     size_t pos = 0;
     size_t nextPos;
@@ -399,20 +356,24 @@ bool downloadPackageFiles(const CContext& context,
     std::filesystem::path archiveFilePath = context.GlobalSettings.DistrDir / (url.data() + pos);
 
     // Check presence & hash
+    // Archive can be shared by several packages (or build types), download it once
+    FileLock archiveLock;
+    if (!archiveLock.lock(lockPathFor(archiveFilePath)))
+      return false;
     bool fileExists = false;
     if (std::filesystem::exists(archiveFilePath)) {
-      std::string existingHash = sha3FileHash(archiveFilePath);
+      std::string existingHash = archiveHash(archiveFilePath);
       if (existingHash.empty()) {
-        fprintf(stderr, "ERROR: can't calculate SHA3 hash of %s\n", archiveFilePath.string().c_str());
+        fprintf(stderr, "ERROR: can't calculate %s hash of %s\n", hashName, archiveFilePath.string().c_str());
         return false;
       }
 
-      if (existingHash == sha3) {
+      if (existingHash == expectedHash) {
         printf("Archive %s already exists\n", archiveFilePath.string().c_str());
         fileExists = true;
       }
       else {
-        fprintf(stderr, "SHA3 mismatch: sha3(%s)=%s, required %s\n", archiveFilePath.string().c_str(), existingHash.c_str(), sha3.c_str());
+        fprintf(stderr, "%s mismatch: %s(%s)=%s, required %s\n", hashName, hashName, archiveFilePath.string().c_str(), existingHash.c_str(), expectedHash.c_str());
         if (!std::filesystem::remove(archiveFilePath)) {
           fprintf(stderr, "ERROR: can't delete file %s\n", archiveFilePath.string().c_str());
           return false;
@@ -421,20 +382,44 @@ bool downloadPackageFiles(const CContext& context,
     }
 
     if (!fileExists) {
-      // Downloading file
-      if (!runNoCapture(".", "wget", { url, "-O", archiveFilePath.string() }, {}, true)) {
+      // Downloading file, body written to archive and hashed as it arrives
+      printf("Downloading %s\n", url.c_str());
+      fflush(stdout);
+      CCtxSha3 sha3Ctx;
+      CCtxK12 k12Ctx;
+      sha3Init(&sha3Ctx, 32);
+      k12StreamInit(&k12Ctx);
+      bool useK12 = !k12.empty();
+      auto hashSink = [&](const uint8_t *data, size_t size) {
+        if (useK12)
+          k12StreamUpdate(&k12Ctx, data, size);
+        else
+          sha3Update(&sha3Ctx, data, size);
+        return true;
+      };
+      if (!httpDownloadFile(url, archiveFilePath, hashSink, expectedSize)) {
         fprintf(stderr, "Can't download file %s\n", url.c_str());
         return false;
       }
 
-      std::string downloadedHash = sha3FileHash(archiveFilePath);
-      if (downloadedHash != sha3) {
-        fprintf(stderr, "SHA3 mismatch: sha3(%s)=%s, required %s\n", archiveFilePath.string().c_str(), downloadedHash.c_str(), sha3.c_str());
+      uint8_t digest[32];
+      char digestHex[72] = {0};
+      if (useK12)
+        k12StreamFinal(&k12Ctx, digest, sizeof(digest));
+      else
+        sha3Final(&sha3Ctx, digest, 0);
+      bin2hexLowerCase(digest, digestHex, sizeof(digest));
+      std::string downloadedHash = digestHex;
+      if (downloadedHash != expectedHash) {
+        fprintf(stderr, "%s mismatch: %s(%s)=%s, required %s\n", hashName, hashName, archiveFilePath.string().c_str(), downloadedHash.c_str(), expectedHash.c_str());
+        std::error_code ec;
+        std::filesystem::remove(archiveFilePath, ec);
         return false;
       }
     }
 
     // Unpacking file
+    // Archive lock held until unpacked: package with same archive name but other hash would replace it
     // Detect archive type
     auto archiveFilePathPosix = pathConvert(archiveFilePath, EPathType::Posix);
     auto destinationPosix = pathConvert(destination, EPathType::Posix);
@@ -469,7 +454,8 @@ bool downloadPackageFiles(const CContext& context,
         }
     } else if (endsWith(archiveFilePathPosix.string(), ".tar.zst")) {
       std::string tmpFileName = archiveFilePathPosix.filename().string();
-      std::filesystem::path tmpFilePath = context.GlobalSettings.DistrDir / ("tmp-" + tmpFileName.substr(0, tmpFileName.size() - 4));
+      // Unique temporary file for each destination, same archive can be unpacked concurrently
+      std::filesystem::path tmpFilePath = context.GlobalSettings.DistrDir / ("tmp-" + sha3StringHashBase64url(destination.string(), 9) + "-" + tmpFileName.substr(0, tmpFileName.size() - 4));
       std::filesystem::path tmpFilePathPosix = pathConvert(tmpFilePath, EPathType::Posix);
       bool success = true;
       if (!runNoCapture(".", "unzstd", { archiveFilePathPosix.string(), "-o", tmpFilePathPosix.string() }, {}, true) ||
@@ -533,16 +519,14 @@ static bool removeDirectory(const std::filesystem::path &path)
   return true;
 }
 
-static bool collectDependencies(const std::filesystem::path &buildFile,
-                                const std::string &variable,
+static bool collectDependencies(const std::string &value,
                                 const std::string &parentName,
                                 std::map<std::string, CPackage> &allPackages,
                                 CContext &context,
                                 bool verbose,
                                 std::vector<CPackage> &out)
 {
-  std::string value;
-  if (!loadSingleVariable(buildFile, variable, value) || value.empty())
+  if (value.empty())
     return true;
 
   StringSplitter splitter(value, "\r\n ");
@@ -575,83 +559,126 @@ static bool collectDependencies(const std::filesystem::path &buildFile,
   return true;
 }
 
-bool install(CContext &context, std::map<std::string, CPackage> &allPackages, CPackage &package, const std::string &buildType, bool verbose, const std::filesystem::path &externalPrefix="")
+struct CInstallGraph {
+  std::vector<CInstallNode> Nodes;
+  std::map<std::filesystem::path, size_t> Index;
+  std::set<std::filesystem::path> InProgress;
+};
+
+static bool addInstallNode(CContext &context,
+                           std::map<std::string, CPackage> &allPackages,
+                           CPackage &package,
+                           const std::string &buildType,
+                           bool verbose,
+                           CInstallGraph &graph,
+                           size_t &index);
+
+static bool resolveInstallNode(CContext &context,
+                               std::map<std::string, CPackage> &allPackages,
+                               CPackage &package,
+                               const std::string &buildType,
+                               bool verbose,
+                               CInstallGraph &graph,
+                               CInstallNode &node)
 {
-  printf("Installing package %s (%s) to %s\n", package.Name.c_str(), buildType.c_str(), package.Prefix.string().c_str());
+  if (!graph.InProgress.insert(package.Prefix).second) {
+    fprintf(stderr, "ERROR: circular dependency detected at package %s\n", package.Name.c_str());
+    return false;
+  }
 
-  // Downloading
-  // Load package source information
-  // Get distr type and url
-  std::string type;
-  std::string url;
-  std::string sha3;
-  {
-    std::vector<std::string> variables;
-    if (!loadVariables(package.BuildFile, {"TYPE", "URL", "SHA3", "TAG", "COMMIT"}, variables)) {
-      fprintf(stderr, "ERROR, can't load DISTR_TYPE, DISTR_URL and DISTR_SHA3 from %s\n", package.BuildFile.string().c_str());
+  node.Package = package;
+  node.BuildType = buildType;
+
+  std::vector<CPackage> deps;
+  if (!collectDependencies(package.Metadata.Depends, package.Name, allPackages, context, verbose, deps))
+    return false;
+  for (auto &dep : deps) {
+    size_t index;
+    updatePackagePrefix(context, dep, buildType, verbose);
+    if (!addInstallNode(context, allPackages, dep, buildType, verbose, graph, index))
       return false;
-    }
+    node.Depends.push_back(index);
+  }
 
-    type = std::move(variables[0]);
-    url = std::move(variables[1]);
-    sha3 = std::move(variables[2]);
+  std::vector<CPackage> binaryDeps;
+  if (!collectDependencies(package.Metadata.DependsBinary, package.Name, allPackages, context, verbose, binaryDeps))
+    return false;
+  for (auto &dep : binaryDeps) {
+    CInstallNode binaryNode;
+    updatePackagePrefix(context, dep, buildType, verbose);
+    if (!resolveInstallNode(context, allPackages, dep, buildType, verbose, graph, binaryNode))
+      return false;
+    // Binary dependency installed as part of this node, so inherit its graph edges
+    node.Depends.insert(node.Depends.end(), binaryNode.Depends.begin(), binaryNode.Depends.end());
+    node.BinaryDepends.push_back(std::move(binaryNode));
   }
 
-  std::filesystem::path sourceDir = context.GlobalSettings.HomeDir / ".s";
-  std::filesystem::path buildDir = context.GlobalSettings.HomeDir / ".b";
-  std::filesystem::path installDir = externalPrefix.empty() ? package.Prefix / "install" : externalPrefix / "install";
-  bool installDirNeedCreate = externalPrefix.empty();
+  graph.InProgress.erase(package.Prefix);
+  return true;
+}
 
-  // Check for already installed
-  {
-    std::ifstream hManifest(package.Prefix / "manifest.txt");
-    if (hManifest) {
-      //char *line = nullptr;
-      size_t length = 0;
-      //ssize_t nRead;
-      auto beginPt = std::chrono::steady_clock::now();
-      unsigned count = 0;
-      uint64_t ms = 0;
-      bool packageInstalled = true;
-      bool allFilesChecked = true;
-      std::string line;
-      while (std::getline(hManifest, line)) {
-        size_t pos = line.find('!');
-        if (pos == std::string::npos || pos == 0 || line.size()-pos < 64) {
-          fprintf(stderr, "WARNING: broken manifest %s\n", (package.Prefix / "manifest.txt").string().c_str());
-          packageInstalled = false;
-          break;
-        }
+static bool addInstallNode(CContext &context,
+                           std::map<std::string, CPackage> &allPackages,
+                           CPackage &package,
+                           const std::string &buildType,
+                           bool verbose,
+                           CInstallGraph &graph,
+                           size_t &index)
+{
+  // One node per prefix, shared by all dependents
+  auto It = graph.Index.find(package.Prefix);
+  if (It != graph.Index.end()) {
+    index = It->second;
+    return true;
+  }
 
-        // get next file hash
-        std::string relativePath = line.substr(0, pos);
-        std::string expectedHash = line.substr(pos+1, 64);
-        std::string hash = sha3FileHash(installDir / relativePath);
-        if (hash.empty()) {
-          fprintf(stderr, "WARNING: can't read package file %s\n", (installDir / relativePath).string().c_str());
-          packageInstalled = false;
-          break;
-        }
+  CInstallNode node;
+  if (!resolveInstallNode(context, allPackages, package, buildType, verbose, graph, node))
+    return false;
 
-        if (hash != expectedHash) {
-          fprintf(stderr, "WARNING: file %s corrupted, need reinstall\n", (installDir / relativePath).string().c_str());
-          packageInstalled = false;
-          break;
-        }
+  index = graph.Nodes.size();
+  graph.Index[package.Prefix] = index;
+  graph.Nodes.push_back(std::move(node));
+  return true;
+}
 
-        count++;
-        ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - beginPt).count();
-        if (ms >= 125) {
-          allFilesChecked = false;
-          break;
-        }
-      }
+bool install(CContext &context,
+             const CPackage &package,
+             const std::vector<CInstallNode> &binaryDepends,
+             const std::string &buildType,
+             bool verbose,
+             const std::filesystem::path &externalPrefix="")
+{
+  // Another process can install same package right now: wait for it and reuse result
+  FileLock prefixLock;
+  bool waited = false;
+  if (!prefixLock.lock(lockPathFor(package.Prefix), &waited))
+    return false;
+  if (waited)
+    printf("Package %s was being installed by another process, checking its result\n", package.Name.c_str());
 
-      if (packageInstalled) {
-        printf("Verified %u%s files in %u milliseconds\n", count, allFilesChecked ? "(all!)" : "", static_cast<unsigned>(ms));
-        printf("Package %s seems to be already installed\n", package.Name.c_str());
-        return true;
-      }
+  printf("Installing package %s (%s) to %s\n", package.Name.c_str(), buildType.c_str(), package.Prefix.string().c_str());
+
+  std::filesystem::path sourceDir = packageSourceDir(context.GlobalSettings.HomeDir, package);
+  std::filesystem::path buildDir = packageBuildDir(context.GlobalSettings.HomeDir, package);
+  std::filesystem::path installDir = externalPrefix.empty() ? package.Prefix / "install" : externalPrefix / "install";
+  bool installDirNeedCreate = externalPrefix.empty();
+
+  // Check for already installed
+  {
+    CVerifyStats stats;
+    if (installManifestVerify(package.Prefix, installDir, context.GlobalSettings.VerifyMode, context.GlobalSettings.TextManifest, context.GlobalSettings.HashThreads, stats)) {
+      printf("Verified %zu files (%zu changed), hashed %zu%s (%.1f MB) in %u milliseconds\n",
+             stats.FilesNum,
+             stats.FilesChanged,
+             stats.FilesHashed,
+             stats.FilesHashed == stats.FilesNum ? "(all!)" : "",
+             stats.BytesHashed / 1048576.0,
+             stats.Milliseconds);
+      if (context.GlobalSettings.VerifyMode != EVerifyMode::Fast)
+        printf("Verification coverage: %.1f%% of files in current pass, %u complete passes\n", stats.Coverage * 100.0, stats.Passes);
+      printf("Package %s seems to be already installed\n", package.Name.c_str());
+      return true;
     }
   }
 
@@ -679,41 +706,11 @@ bool install(CContext &context, std::map<std::string, CPackage> &allPackages, CP
     return false;
   }
 
-  // Install depends
-  {
-    std::vector<CPackage> deps;
-    if (!collectDependencies(package.BuildFile, "DEPENDS", package.Name, allPackages, context, verbose, deps))
-      return false;
-    for (auto &dep : deps) {
-      updatePackagePrefix(context, dep, buildType, verbose);
-      if (!install(context, allPackages, dep, buildType, verbose))
-        return false;
-    }
-
-    // Recreate source/build directories after installing dependencies
-    // (they may have been cleaned up by dependency builds)
-    if (!deps.empty() && !package.IsBinary) {
-      if (!std::filesystem::exists(sourceDir) && !std::filesystem::create_directories(sourceDir)) {
-        fprintf(stderr, "ERROR: can't create directory at %s\n", sourceDir.string().c_str());
-        return false;
-      }
-      if (!std::filesystem::exists(buildDir) && !std::filesystem::create_directories(buildDir)) {
-        fprintf(stderr, "ERROR: can't create directory at %s\n", buildDir.string().c_str());
-        return false;
-      }
-    }
-  }
-
   // Install binary depends (into the same install directory as this package)
-  {
-    std::vector<CPackage> binaryDeps;
-    if (!collectDependencies(package.BuildFile, "DEPENDS_BINARY", package.Name, allPackages, context, verbose, binaryDeps))
+  // Regular dependencies already installed by graph scheduler
+  for (const auto &dep : binaryDepends) {
+    if (!install(context, dep.Package, dep.BinaryDepends, buildType, verbose, package.Prefix))
       return false;
-    for (auto &dep : binaryDeps) {
-      updatePackagePrefix(context, dep, buildType, verbose);
-      if (!install(context, allPackages, dep, buildType, verbose, package.Prefix))
-        return false;
-    }
   }
 
   if (!downloadPackageFiles(context, package, sourceDir, installDir))
@@ -748,16 +745,9 @@ bool install(CContext &context, std::map<std::string, CPackage> &allPackages, CP
   }
 
   if (externalPrefix.empty()) {
-    // Create manifest
-    FILE* hManifest = fopen((package.Prefix / "manifest.txt").string().c_str(), "w+");
-    if (!hManifest) {
-      fprintf(stderr, "Can't open manifest file %s\n", (package.Prefix / "manifest.txt").string().c_str());
-      return false;
-    }
-
     printf("Create manifest...\n");
-    createManifestForDirectory(hManifest, installDir, "");
-    fclose(hManifest);
+    if (!installManifestCreate(installDir, package.Prefix, context.GlobalSettings.TextManifest, context.GlobalSettings.HashThreads))
+      return false;
   }
 
   // Cleanup
@@ -770,37 +760,35 @@ bool install(CContext &context, std::map<std::string, CPackage> &allPackages, CP
   return true;
 }
 
-std::filesystem::path searchPath(const std::filesystem::path& prefix, const std::filesystem::path &name)
+bool installGraph(CContext &context, const CInstallGraph &graph, unsigned jobs, bool verbose)
 {
-  std::filesystem::path result;
-  std::ifstream hManifest(prefix / "manifest.txt");
-  if (hManifest) {
-    size_t length = 0;
-    std::string line;
-    while (std::getline(hManifest, line)) {
-      size_t pos = line.find('!');
-      if (pos == std::string::npos || pos == 0 || line.size() - pos < 64) {
-        fprintf(stderr, "WARNING: broken manifest %s\n", (prefix / "manifest.txt").string().c_str());
-        return std::filesystem::path();
-      }
+  std::vector<std::vector<size_t>> depends;
+  for (const auto &node: graph.Nodes)
+    depends.push_back(node.Depends);
 
-      // get next file hash
-      std::string relativePath = line.substr(0, pos);
-      if (endsWith(relativePath, name.string())) {
-        if (!result.empty()) {
-          fprintf(stderr, "ERROR: more than one file in package\n");
-          return std::filesystem::path();
-        }
+  // Packages installed at once split cores for archive hashing
+  size_t concurrent = std::max<size_t>(1, std::min<size_t>(jobs, graph.Nodes.size()));
+  context.GlobalSettings.HashThreads = std::max(1u, static_cast<unsigned>(std::thread::hardware_concurrency() / concurrent));
 
-        result = prefix / "install" / relativePath;
-      }
-    }
-  } else {
-    fprintf(stderr, "ERROR: manifest not found, package not installed\n");
+  if (verbose)
+    printf("Install graph: %zu packages, %u jobs\n", graph.Nodes.size(), jobs);
+
+  return dagRun(depends, jobs, [&context, &graph, verbose](size_t index) -> bool {
+    const CInstallNode &node = graph.Nodes[index];
+    return install(context, node.Package, node.BinaryDepends, node.BuildType, verbose);
+  });
+}
+
+std::filesystem::path searchPath(const InstallManifest &manifest, const std::filesystem::path& prefix, const std::filesystem::path &name)
+{
+  size_t index;
+  size_t count = manifest.findSuffix(name.string(), index);
+  if (count > 1) {
+    fprintf(stderr, "ERROR: more than one file in package\n");
     return std::filesystem::path();
   }
 
-  return result;
+  return count ? prefix / "install" / manifest.path(index) : std::filesystem::path();
 }
 
 
@@ -830,14 +818,35 @@ void packageVersionList(const CPackage &package)
 
   // Load default version
   std::string defaultVersion;
-  if (!loadSingleVariable(package.Path / "meta.build", "DEFAULT_VERSION", defaultVersion))
+  if (package.Indexed)
+    defaultVersion = package.IndexedDefaultVersion;
+  else if (!loadSingleVariable(package.Path / "meta.build", "DEFAULT_VERSION", defaultVersion))
     defaultVersion = "(unknown)";
 
   printf("Package: %s\n", package.Name.c_str());
   printf("Default version: %s\n", defaultVersion.c_str());
   puts("\nAvailable versions:");
-  for (const auto &v : versions)
-    printf("  %s\n", v.c_str());
+  for (const auto &v : versions) {
+    auto It = std::find_if(package.IndexedVersions.begin(), package.IndexedVersions.end(), [&v](const CIndexedVersion &indexed) {
+      return indexed.Version == v;
+    });
+    if (It == package.IndexedVersions.end()) {
+      printf("  %s\n", v.c_str());
+      continue;
+    }
+
+    std::string depends;
+    StringSplitter splitter(It->Depends + " " + It->DependsBinary, "\r\n ");
+    while (splitter.next()) {
+      if (!depends.empty())
+        depends.append(", ");
+      depends.append(splitter.get());
+    }
+    if (depends.empty())
+      printf("  %s\n", v.c_str());
+    else
+      printf("  %s (depends: %s)\n", v.c_str(), depends.c_str());
+  }
 }
 
 bool verifyManifest(const std::filesystem::path &dir)
@@ -890,11 +899,26 @@ bool verifyManifest(const std::filesystem::path &dir)
     expectedEntries[name] = hash;
   }
 
-  // Collect actual entries (excluding .git, MANIFEST, SIGN)
+  // Optional Merkle manifest: digests of all subdirectories and files, used for reporting changed files
+  // It's not signed, but authenticated by MANIFEST: top level digests must match it
+  CMerkleNode tree;
+  bool hasTree = false;
+  std::filesystem::path treePath = dir / MERKLE_MANIFEST_FILENAME;
+  if (std::filesystem::exists(treePath)) {
+    hasTree = merkleLoad(treePath, tree) && tree.Children.size() == expectedEntries.size();
+    for (auto It = tree.Children.begin(); hasTree && It != tree.Children.end(); ++It) {
+      auto expectedIt = expectedEntries.find(It->first);
+      hasTree = expectedIt != expectedEntries.end() && expectedIt->second == It->second.Digest;
+    }
+    if (!hasTree)
+      puts("WARNING: MANIFEST.tree is invalid or not matches MANIFEST, ignored");
+  }
+
+  // Collect actual entries (excluding .git, MANIFEST, SIGN, MANIFEST.tree)
   std::set<std::string> actualEntries;
   for (const auto &entry : std::filesystem::directory_iterator(dir)) {
     std::string name = entry.path().filename().string();
-    if (name == ".git" || name == MANIFEST_FILENAME || name == SIGN_FILENAME)
+    if (name == ".git" || name == MANIFEST_FILENAME || name == SIGN_FILENAME || name == MERKLE_MANIFEST_FILENAME)
       continue;
     actualEntries.insert(name);
   }
@@ -917,16 +941,26 @@ bool verifyManifest(const std::filesystem::path &dir)
       continue;
     }
 
-    std::string actualHash;
-    if (std::filesystem::is_directory(entryPath))
-      actualHash = sha3DirectoryHash(entryPath, MANIFEST_FILENAME);
-    else
-      actualHash = sha3FileHash(entryPath);
+    std::string actualHash = std::filesystem::is_directory(entryPath) ?
+      sha3DirectoryHash(entryPath, MANIFEST_FILENAME, std::thread::hardware_concurrency()) :
+      sha3FileHash(entryPath);
 
     if (actualHash != expectedHash) {
       fprintf(stderr, "ERROR: hash mismatch for %s\n", name.c_str());
       fprintf(stderr, "  expected: %s\n", expectedHash.c_str());
       fprintf(stderr, "  actual:   %s\n", actualHash.c_str());
+      // Tree of actual files built only for mismatched entry (hashed again, serially)
+      CMerkleNode actualTree;
+      if (hasTree && !actualHash.empty() && merkleBuild(entryPath, MANIFEST_FILENAME, actualTree)) {
+        // Descend only into mismatched subtrees
+        std::vector<CMerkleDifference> differences;
+        merkleDiff(tree.Children[name], actualTree, differences);
+        for (const auto &difference : differences) {
+          const char *type = difference.Type == EMerkleDifference::Added ? "unexpected" :
+                             difference.Type == EMerkleDifference::Removed ? "missing" : "changed";
+          fprintf(stderr, "  %s: %s%s%s\n", type, name.c_str(), difference.Path.empty() ? "" : "/", difference.Path.c_str());
+        }
+      }
       success = false;
     }
   }
@@ -963,7 +997,7 @@ bool updateRepository(const std::filesystem::path &cxxpmRoot, const std::string
     printf("Cloning repository to %s\n", packagesDir.string().c_str());
     if (!runNoCapture(packagesDir, "git", {"clone", expectedRepository, "."}, {}, true, true))
       return false;
-    return verifyManifest(packagesDir);
+    return verifyManifest(packagesDir) && repositoryIndexBuild(packagesDir, repositoryIndexPath(cxxpmRoot));
   }
 
   // Update existing repository
@@ -996,7 +1030,56 @@ bool updateRepository(const std::filesystem::path &cxxpmRoot, const std::string
 
   if (!runNoCapture(packagesDir, "git", {"pull"}, {}, true, true))
     return false;
-  return verifyManifest(packagesDir);
+  return verifyManifest(packagesDir) && repositoryIndexBuild(packagesDir, repositoryIndexPath(cxxpmRoot));
+}
+
+static bool diffPrefix(const std::filesystem::path &left, const std::filesystem::path &right)
+{
+  CMerkleNode leftTree;
+  CMerkleNode rightTree;
+  if (!installManifestTree(left, leftTree)) {
+    fprintf(stderr, "ERROR: can't load manifest from %s\n", left.string().c_str());
+    return false;
+  }
+  if (!installManifestTree(right, rightTree)) {
+    fprintf(stderr, "ERROR: can't load manifest from %s\n", right.string().c_str());
+    return false;
+  }
+
+  std::vector<CMerkleDifference> differences;
+  size_t compared = merkleDiff(leftTree, rightTree, differences);
+  for (const auto &difference : differences) {
+    char type = difference.Type == EMerkleDifference::Added ? '+' : difference.Type == EMerkleDifference::Removed ? '-' : 'M';
+    printf("%c %s\n", type, difference.Path.empty() ? "." : difference.Path.c_str());
+  }
+  printf("%zu differences, %zu nodes compared\n", differences.size(), compared);
+  return true;
+}
+
+static void lockAddNode(const CInstallNode &node, CLockFile &lock, bool isBinaryDependency)
+{
+  const CPackage &package = node.Package;
+  lock.Inputs[package.Path] = fileStamp(package.Path);
+  lock.Inputs[package.Path / "meta.build"] = fileStamp(package.Path / "meta.build");
+  for (const auto &extraPath: package.ExtraPath)
+    lock.Inputs[extraPath] = fileStamp(extraPath);
+  lock.Inputs[package.BuildFile] = fileStamp(package.BuildFile);
+  for (const auto &sourced: package.Metadata.SourcedFiles)
+    lock.Inputs[sourced] = fileStamp(sourced);
+
+  // Binary dependencies have no own manifest, they are part of dependent package prefix
+  if (!isBinaryDependency) {
+    CLockedPackage &locked = lock.Packages.emplace_back();
+    locked.Name = package.Name;
+    locked.Version = package.Version;
+    locked.BuildType = node.BuildType;
+    locked.BuildFile = package.BuildFile;
+    locked.Prefix = package.Prefix;
+    locked.Manifest = sha3FileHash(installManifestPath(package.Prefix));
+  }
+
+  for (const auto &binaryNode: node.BinaryDepends)
+    lockAddNode(binaryNode, lock, true);
 }
 
 void printHelp()
@@ -1014,6 +1097,7 @@ void printHelp()
   puts("  --update\t\t\tUpdate package repository");
   puts("  --repository <url>\t\tRepository URL (for --update)");
   puts("  --install-msys2 [packages]\tInstall msys2 packages (comma-separated)");
+  puts("  --diff-prefix <prefix>\tCompare manifests of two package prefixes, must be used twice");
   puts("Compiler options:");
   puts("  --compiler <lang:path>\tSet compiler path (e.g., cxx:/usr/bin/g++)");
   puts("  --compiler-flags <lang:flags>");
@@ -1027,9 +1111,14 @@ void printHelp()
   puts("  --isysroot <path>\t\tSystem root path");
   puts("Package options:");
   puts("  --package-extra-dir <dir>\tAdditional package directory");
+  puts("  --jobs <number>\t\tMaximum number of packages installed at once");
   puts("  --export-cmake <path>\t\tExport CMake config");
+  puts("  --lock <file>\t\t\tSkip install if nothing changed since run with same lock file");
+  puts("  --verify <mode>\t\tCheck of installed packages: fast, sampled (default), full");
+  puts("  --text-manifest\t\tWrite text manifest.txt to package prefix too");
+  puts("  --no-hash-cache\t\tRe-hash files even if not changed since last run");
   puts("  --search-path-type <type>\tPath type (native, posix, windows)");
-  puts("  --file <name>\t\t\tSearch for file in package");
+  puts("  --file <name>\t\t\tSearch for file in package, can be used multiple times");
   puts("Other:");
   puts("  --cxxpm-root <path>\t\tSet cxx-pm root directory");
   puts("  --vs-install-dir <path>\tVisual Studio install directory");
@@ -1063,13 +1152,19 @@ int main(int argc, char **argv)
   std::filesystem::path isysRoot;
   std::string buildType = "Release";
   std::string buildTypeMapping = "Debug:Debug;*:Release";
-  std::string fileArgument;
+  std::vector<std::string> fileArguments;
   std::filesystem::path outputPath;
   bool exportCmake = false;
   bool verbose = false;
+  bool useHashCache = true;
   EPathType pathType = EPathType::Native;
   std::string repository = "https://github.com/eXtremal-ik7/cxx-pm-repo";
   std::vector<std::string> msys2PackageNames;
+  std::vector<std::filesystem::path> diffPrefixes;
+  unsigned jobs = std::thread::hardware_concurrency();
+  std::filesystem::path lockPath;
+  // Options which can change result, used for lock file fingerprint
+  std::vector<std::string> lockArguments;
   CContext context;
 
 #ifdef WIN32
@@ -1079,6 +1174,8 @@ int main(int argc, char **argv)
   int res;
   int index = 0;
   while ((res = getopt_long(argc, argv, "", cmdLineOpts, &index)) != -1) {
+    if (res != '?' && res != ':' && res != clOptLock && res != clOptVerbose && res != clOptJobs && res != clOptVerify && res != clOptNoHashCache)
+      lockArguments.push_back(std::string(cmdLineOpts[index].name) + "=" + (optarg ? optarg : ""));
     switch (res) {
       case clOptCxxpmRoot: {
         cxxpmRoot = optarg;
@@ -1209,6 +1306,15 @@ int main(int argc, char **argv)
         }
         break;
       }
+      case clOptDiffPrefix : {
+        if (mode != ENoMode && mode != EDiffPrefix) {
+          fprintf(stderr, "ERROR: mode already specified\n");
+          exit(1);
+        }
+        mode = EDiffPrefix;
+        diffPrefixes.push_back(optarg);
+        break;
+      }
       case clOptRepository :
         repository = optarg;
         break;
@@ -1221,11 +1327,36 @@ int main(int argc, char **argv)
         extraPackageDirs.push_back(optarg);
         break;
       case clOptFile :
-        fileArgument = optarg;
+        fileArguments.push_back(optarg);
         break;
       case clOptVerbose :
         verbose = true;
         break;
+      case clOptJobs : {
+        char *end = nullptr;
+        unsigned long value = strtoul(optarg, &end, 10);
+        if (end == optarg || *end != '\0' || value == 0) {
+          fprintf(stderr, "ERROR: invalid jobs number: %s\n", optarg);
+          return 1;
+        }
+        jobs = static_cast<unsigned>(value);
+        break;
+      }
+      case clOptLock :
+        lockPath = optarg;
+        break;
+      case clOptTextManifest :
+        context.GlobalSettings.TextManifest = true;
+        break;
+      case clOptNoHashCache :
+        useHashCache = false;
+        break;
+      case clOptVerify :
+        if (!verifyModeFromString(optarg, context.GlobalSettings.VerifyMode)) {
+          fprintf(stderr, "ERROR: invalid verify mode: %s\n", optarg);
+          return 1;
+        }
+        break;
       case ':' :
         fprintf(stderr, "Error: option %s missing argument\n", cmdLineOpts[index].name);
         break;
@@ -1245,6 +1376,28 @@ int main(int argc, char **argv)
   if (cxxpmRoot.empty())
     cxxpmRoot = userHomeDir() / ".cxxpm" / "self";
 
+  // Before --update: repository index is built from cached build file variables
+  metadataCacheSetDirectory(userHomeDir() / ".cxxpm" / ".cache" / "metadata");
+  // Full verification trusts nothing
+  hashCacheSetDirectory(userHomeDir() / ".cxxpm" / ".cache" / "hash",
+                        useHashCache && context.GlobalSettings.VerifyMode != EVerifyMode::Full);
+
+  // Lock file fast path: nothing to resolve, install or export
+  std::string lockFingerprint;
+  if (mode == EInstall && !lockPath.empty()) {
+    lockFingerprint = lockFileFingerprint(context.SystemInfo.Self, lockArguments);
+    if (lockFileCheck(lockPath, lockFingerprint, context.GlobalSettings.VerifyMode, context.GlobalSettings.TextManifest, verbose))
+      return 0;
+  }
+
+  if (mode == EDiffPrefix) {
+    if (diffPrefixes.size() != 2) {
+      fprintf(stderr, "ERROR: --diff-prefix must be used twice\n");
+      return 1;
+    }
+    return diffPrefix(diffPrefixes[0], diffPrefixes[1]) ? 0 : 1;
+  }
+
   // Handle install-msys2 mode early, before msys2 bundle check
   if (mode == EInstallMsys2) {
     if (!msys2Install(cxxpmRoot, msys2PackageNames))
@@ -1284,6 +1437,9 @@ int main(int argc, char **argv)
   if (mode == EUpdate) {
     if (!updateRepository(cxxpmRoot, repository))
       return 1;
+    size_t pruned = hashCachePrune(userHomeDir() / ".cxxpm" / ".cache" / "hash", std::chrono::hours(24 * 30));
+    if (pruned)
+      printf("Removed %zu stale hash cache entries\n", pruned);
     return 0;
   }
 
@@ -1347,14 +1503,18 @@ int main(int argc, char **argv)
   // Load all packages
   std::map<std::string, CPackage> packages;
   std::set<std::filesystem::path> visited;
-  for (const auto &folder: std::filesystem::directory_iterator{cxxpmRoot / "packages"}) {
-    std::string name = folder.path().filename().string();
-    if (name.empty() || name[0] == '.' || name == MANIFEST_FILENAME || name == SIGN_FILENAME)
-      continue;
-    CPackage package;
-    package.Name = name;
-    package.Path = folder.path();
-    packages.insert(std::make_pair(package.Name, package));
+  if (!repositoryIndexLoad(cxxpmRoot / "packages", repositoryIndexPath(cxxpmRoot), packages)) {
+    if (verbose)
+      printf("Repository index not found or outdated, scanning %s\n", (cxxpmRoot / "packages").string().c_str());
+    for (const auto &folder: std::filesystem::directory_iterator{cxxpmRoot / "packages"}) {
+      std::string name = folder.path().filename().string();
+      if (name.empty() || name[0] == '.' || name == MANIFEST_FILENAME || name == SIGN_FILENAME || name == MERKLE_MANIFEST_FILENAME)
+        continue;
+      CPackage package;
+      package.Name = name;
+      package.Path = folder.path();
+      packages.insert(std::make_pair(package.Name, package));
+    }
   }
 
   for (const auto &extraPackageDir: extraPackageDirs) {
@@ -1362,9 +1522,9 @@ int main(int argc, char **argv)
       fprintf(stderr, "ERROR: extra package directory %s specified twice\n", extraPackageDir.string().c_str());
       exit(1);
     }
-    for (const auto &folder: std::filesystem::directory_iterator{cxxpmRoot / "packages"}) {
+    for (const auto &folder: std::filesystem::directory_iterator{extraPackageDir}) {
       std::string name = folder.path().filename().string();
-      if (name.empty() || name[0] == '.' || name == MANIFEST_FILENAME || name == SIGN_FILENAME)
+      if (name.empty() || name[0] == '.' || name == MANIFEST_FILENAME || name == SIGN_FILENAME || name == MERKLE_MANIFEST_FILENAME)
         continue;
       auto It = packages.find(name);
       if (It == packages.end()) {
@@ -1421,14 +1581,22 @@ int main(int argc, char **argv)
         return 1;
       updatePackagePrefix(context, package, buildType, verbose);
 
-      if (!fileArgument.empty()) {
-        auto path = searchPath(package.Prefix, std::filesystem::path(fileArgument).make_preferred());
-        if (!path.empty()) {
-          printf("%s\n", pathConvert(path, pathType).string().c_str());
-        } else {
-          fprintf(stderr, "ERROR: no file %s in package %s\n", fileArgument.c_str(), packageName.c_str());
+      if (!fileArguments.empty()) {
+        // One manifest load for all queries, results printed in order of --file options
+        InstallManifest manifest;
+        if (!manifest.open(package.Prefix)) {
+          fprintf(stderr, "ERROR: manifest not found, package not installed\n");
           exit(1);
         }
+        for (const auto &fileArgument: fileArguments) {
+          auto path = searchPath(manifest, package.Prefix, std::filesystem::path(fileArgument).make_preferred());
+          if (!path.empty()) {
+            printf("%s\n", pathConvert(path, pathType).string().c_str());
+          } else {
+            fprintf(stderr, "ERROR: no file %s in package %s\n", fileArgument.c_str(), packageName.c_str());
+            exit(1);
+          }
+        }
       } else {
         printf("%s\n", pathConvert(package.Prefix, pathType).string().c_str());
       }
@@ -1450,16 +1618,21 @@ int main(int argc, char **argv)
       std::vector<std::string> buildTypes;
       uniqueBuildTypes(context.SystemInfo.BuildType, buildTypes);
 
+      CInstallGraph graph;
       for (const auto &buildType: buildTypes) {
+        size_t index;
         updatePackagePrefix(context, package, buildType, verbose);
-        if (!install(context, packages, package, buildType, verbose))
+        if (!addInstallNode(context, packages, package, buildType, verbose, graph, index))
           return 1;
       }
 
+      if (!installGraph(context, graph, jobs, verbose))
+        return 1;
+
       // CMake export
       if (exportCmake) {
         std::vector<CPackage> dependencies;
-        if (!collectDependencies(package.BuildFile, "DEPENDS", package.Name, packages, context, verbose, dependencies))
+        if (!collectDependencies(package.Metadata.Depends, package.Name, packages, context, verbose, dependencies))
           return 1;
         for (auto &dep : dependencies) {
           for (const auto &bt : buildTypes)
@@ -1469,8 +1642,37 @@ int main(int argc, char **argv)
         if (!cmakeExport(package, dependencies, context.GlobalSettings, context.Compilers, context.Tools, context.SystemInfo, outputPath, verbose))
           return 1;
       }
+
+      if (!lockPath.empty()) {
+        CLockFile lock;
+        lock.Fingerprint = lockFingerprint;
+        for (const auto &dir: extraPackageDirs)
+          lock.Inputs[dir] = fileStamp(dir);
+        for (const auto &compiler: context.Compilers) {
+          if (compiler.Command.empty())
+            continue;
+          std::filesystem::path compilerPath = executablePath(compiler.Command);
+          if (!compilerPath.empty())
+            lock.Inputs[compilerPath] = fileStamp(compilerPath);
+        }
+        for (const auto &node: graph.Nodes)
+          lockAddNode(node, lock, false);
+        if (exportCmake) {
+          lock.ExportPath = std::filesystem::absolute(outputPath);
+          std::ifstream file(outputPath, std::ios::binary);
+          std::stringstream content;
+          content << file.rdbuf();
+          lock.ExportContent = content.str();
+        }
+        if (!lockFileStore(lockPath, lock))
+          return 1;
+      }
       break;
     }
+    case EInstallMsys2 :
+    case EDiffPrefix :
+      // Handled above
+      break;
   }
 
   return 0;
@@ -2,6 +2,7 @@
 #include "ecdsa.h"
 #include "strExtras.h"
 #include "manifest.h"
+#include "merkle.h"
 #include <filesystem>
 #include <fstream>
 #include <sstream>
@@ -12,43 +13,36 @@
 enum CmdLineOptsTy {
   optHelp = 1,
   optPrivateKey,
-  optTarget
+  optTarget,
+  optMerkle
 };
 
 static option cmdLineOpts[] = {
   {"help", no_argument, nullptr, optHelp},
   {"private-key", required_argument, nullptr, optPrivateKey},
   {"target", required_argument, nullptr, optTarget},
+  {"merkle", no_argument, nullptr, optMerkle},
   {nullptr, 0, nullptr, 0}
 };
 
-static std::string computeHash(const std::filesystem::path &path)
+// Top level entries of tree are MANIFEST lines
+std::string generateManifestContent(const std::filesystem::path &dir, CMerkleNode &tree)
 {
-  if (std::filesystem::is_directory(path))
-    return sha3DirectoryHash(path, MANIFEST_FILENAME);
-  else
-    return sha3FileHash(path);
-}
-
-std::string generateManifestContent(const std::filesystem::path &dir)
-{
-  std::map<std::string, std::string> entries;
-
+  tree = CMerkleNode();
+  tree.IsDirectory = true;
   for (const auto &entry : std::filesystem::directory_iterator(dir)) {
     std::string name = entry.path().filename().string();
-    if (name == MANIFEST_FILENAME || name == SIGN_FILENAME || (!name.empty() && name[0] == '.'))
+    if (name == MANIFEST_FILENAME || name == SIGN_FILENAME || name == MERKLE_MANIFEST_FILENAME || (!name.empty() && name[0] == '.'))
       continue;
-    std::string hash = computeHash(entry.path());
-    if (hash.empty()) {
+    if (!merkleBuild(entry.path(), MANIFEST_FILENAME, tree.Children[name])) {
       fprintf(stderr, "ERROR: failed to compute hash for %s\n", entry.path().string().c_str());
       return std::string();
     }
-    entries[name] = hash;
   }
 
   std::ostringstream oss;
-  for (const auto &[name, hash] : entries)
-    oss << name << " " << hash << "\n";
+  for (const auto &[name, node] : tree.Children)
+    oss << name << " " << node.Digest << "\n";
 
   return oss.str();
 }
@@ -88,6 +82,7 @@ void printHelp()
   puts("Options:");
   puts("  --private-key <file>\tPath to private key file (required)");
   puts("  --target <dir>\tTarget directory (default: current directory)");
+  puts("  --merkle\t\tAlso write MANIFEST.tree with digests of all files and subdirectories");
   puts("  --help\t\tShow this help message");
 }
 
@@ -95,6 +90,7 @@ int main(int argc, char **argv)
 {
   std::filesystem::path dir = std::filesystem::current_path();
   std::filesystem::path keyPath;
+  bool merkle = false;
 
   int res;
   int index = 0;
@@ -109,6 +105,9 @@ int main(int argc, char **argv)
       case optTarget:
         dir = optarg;
         break;
+      case optMerkle:
+        merkle = true;
+        break;
       case '?':
         return 1;
     }
@@ -125,10 +124,21 @@ int main(int argc, char **argv)
     return 1;
   }
 
-  std::string content = generateManifestContent(dir);
+  CMerkleNode tree;
+  std::string content = generateManifestContent(dir, tree);
   if (content.empty())
     return 1;
 
+  // Stale tree not matches new MANIFEST and will be ignored, but remove it anyway
+  std::filesystem::path treePath = dir / MERKLE_MANIFEST_FILENAME;
+  if (merkle) {
+    if (!merkleStore(treePath, tree))
+      return 1;
+  } else {
+    std::error_code ec;
+    std::filesystem::remove(treePath, ec);
+  }
+
   std::filesystem::path manifestPath = dir / MANIFEST_FILENAME;
   std::ofstream manifestOut(manifestPath);
   if (!manifestOut) {
@@ -170,5 +180,7 @@ int main(int argc, char **argv)
 
   printf("Manifest written to %s\n", manifestPath.string().c_str());
   printf("Signature written to %s\n", signPath.string().c_str());
+  if (merkle)
+    printf("Merkle tree written to %s\n", treePath.string().c_str());
   return 0;
 }
@@ -0,0 +1,288 @@
+#include "mappedfile.h"
+
+#ifdef WIN32
+#include <Windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool MappedFile::open(const std::filesystem::path &path)
+{
+  close();
+
+#ifdef WIN32
+  HANDLE hFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (hFile == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(hFile, &size)) {
+    CloseHandle(hFile);
+    return false;
+  }
+
+  // Empty files can't be mapped
+  if (size.QuadPart == 0) {
+    CloseHandle(hFile);
+    return true;
+  }
+
+  HANDLE mapping = CreateFileMappingW(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(hFile);
+  if (!mapping)
+    return false;
+
+  void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!data) {
+    CloseHandle(mapping);
+    return false;
+  }
+
+  Mapping_ = mapping;
+  Data_ = static_cast<const uint8_t*>(data);
+  Size_ = static_cast<size_t>(size.QuadPart);
+#else
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    ::close(fd);
+    return false;
+  }
+
+  // Empty files can't be mapped
+  if (st.st_size == 0) {
+    ::close(fd);
+    return true;
+  }
+
+  void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED)
+    return false;
+
+  Data_ = static_cast<const uint8_t*>(data);
+  Size_ = st.st_size;
+#endif
+
+  return true;
+}
+
+void MappedFile::close()
+{
+  if (!Data_)
+    return;
+#ifdef WIN32
+  UnmapViewOfFile(Data_);
+  CloseHandle(Mapping_);
+  Mapping_ = nullptr;
+#else
+  munmap(const_cast<uint8_t*>(Data_), Size_);
+#endif
+  Data_ = nullptr;
+  Size_ = 0;
+}
+
+void MappedFile::adviseSequential()
+{
+#ifndef WIN32
+  if (Data_)
+    madvise(const_cast<uint8_t*>(Data_), Size_, MADV_SEQUENTIAL);
+#endif
+}
+
+bool InputFile::open(const std::filesystem::path &path)
+{
+  close();
+
+#ifdef WIN32
+  HANDLE hFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (hFile == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(hFile, &size)) {
+    CloseHandle(hFile);
+    return false;
+  }
+
+  Handle_ = hFile;
+  Size_ = static_cast<uint64_t>(size.QuadPart);
+#else
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || S_ISDIR(st.st_mode)) {
+    ::close(fd);
+    return false;
+  }
+
+  Fd_ = fd;
+  Size_ = st.st_size;
+#endif
+
+  return true;
+}
+
+void InputFile::close()
+{
+#ifdef WIN32
+  if (Handle_)
+    CloseHandle(Handle_);
+  Handle_ = nullptr;
+#else
+  if (Fd_ != -1)
+    ::close(Fd_);
+  Fd_ = -1;
+#endif
+  Size_ = 0;
+}
+
+bool InputFile::isOpen() const
+{
+#ifdef WIN32
+  return Handle_ != nullptr;
+#else
+  return Fd_ != -1;
+#endif
+}
+
+bool InputFile::read(void *buffer, size_t size, size_t *bytesRead)
+{
+#ifdef WIN32
+  DWORD result = 0;
+  DWORD toRead = size > 0x40000000 ? 0x40000000 : static_cast<DWORD>(size);
+  if (!ReadFile(Handle_, buffer, toRead, &result, nullptr))
+    return false;
+  *bytesRead = result;
+  return true;
+#else
+  for (;;) {
+    ssize_t result = ::read(Fd_, buffer, size);
+    if (result >= 0) {
+      *bytesRead = static_cast<size_t>(result);
+      return true;
+    }
+    if (errno != EINTR)
+      return false;
+  }
+#endif
+}
+
+bool InputFile::readFull(void *buffer, size_t size, size_t *bytesRead)
+{
+  uint8_t *p = static_cast<uint8_t*>(buffer);
+  *bytesRead = 0;
+  while (*bytesRead < size) {
+    size_t result = 0;
+    if (!read(p + *bytesRead, size - *bytesRead, &result))
+      return false;
+    if (result == 0)
+      break;
+    *bytesRead += result;
+  }
+  return true;
+}
+
+bool RandomAccessFile::create(const std::filesystem::path &path)
+{
+  close();
+#ifdef WIN32
+  HANDLE hFile = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (hFile == INVALID_HANDLE_VALUE)
+    return false;
+  Handle_ = hFile;
+#else
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd == -1)
+    return false;
+  Fd_ = fd;
+#endif
+  return true;
+}
+
+bool RandomAccessFile::close()
+{
+  bool success = true;
+#ifdef WIN32
+  if (Handle_)
+    success = CloseHandle(Handle_) != 0;
+  Handle_ = nullptr;
+#else
+  if (Fd_ != -1)
+    success = ::close(Fd_) == 0;
+  Fd_ = -1;
+#endif
+  return success;
+}
+
+bool RandomAccessFile::resize(uint64_t size)
+{
+#ifdef WIN32
+  FILE_END_OF_FILE_INFO info;
+  info.EndOfFile.QuadPart = static_cast<LONGLONG>(size);
+  return SetFileInformationByHandle(Handle_, FileEndOfFileInfo, &info, sizeof(info)) != 0;
+#else
+  return ftruncate(Fd_, static_cast<off_t>(size)) == 0;
+#endif
+}
+
+bool RandomAccessFile::readAt(uint64_t offset, void *buffer, size_t size)
+{
+  uint8_t *p = static_cast<uint8_t*>(buffer);
+  while (size) {
+#ifdef WIN32
+    OVERLAPPED overlapped = {};
+    overlapped.Offset = static_cast<DWORD>(offset);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    DWORD result = 0;
+    DWORD toRead = size > 0x40000000 ? 0x40000000 : static_cast<DWORD>(size);
+    if (!ReadFile(Handle_, p, toRead, &result, &overlapped) || result == 0)
+      return false;
+#else
+    ssize_t result = ::pread(Fd_, p, size, static_cast<off_t>(offset));
+    if (result < 0 && errno == EINTR)
+      continue;
+    if (result <= 0)
+      return false;
+#endif
+    p += result;
+    offset += result;
+    size -= result;
+  }
+  return true;
+}
+
+bool RandomAccessFile::writeAt(uint64_t offset, const void *data, size_t size)
+{
+  const uint8_t *p = static_cast<const uint8_t*>(data);
+  while (size) {
+#ifdef WIN32
+    OVERLAPPED overlapped = {};
+    overlapped.Offset = static_cast<DWORD>(offset);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    DWORD result = 0;
+    DWORD toWrite = size > 0x40000000 ? 0x40000000 : static_cast<DWORD>(size);
+    if (!WriteFile(Handle_, p, toWrite, &result, &overlapped))
+      return false;
+#else
+    ssize_t result = ::pwrite(Fd_, p, size, static_cast<off_t>(offset));
+    if (result < 0 && errno == EINTR)
+      continue;
+    if (result < 0)
+      return false;
+#endif
+    p += result;
+    offset += result;
+    size -= result;
+  }
+  return true;
+}
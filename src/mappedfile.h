@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <filesystem>
+
+// Read-only memory mapping of whole file
+class MappedFile {
+public:
+  MappedFile() {}
+  ~MappedFile() { close(); }
+  MappedFile(const MappedFile&) = delete;
+  MappedFile &operator=(const MappedFile&) = delete;
+
+  bool open(const std::filesystem::path &path);
+  void close();
+  // Hint for kernel: mapping will be read once from begin to end
+  void adviseSequential();
+
+  const uint8_t *data() const { return Data_; }
+  size_t size() const { return Size_; }
+
+private:
+  const uint8_t *Data_ = nullptr;
+  size_t Size_ = 0;
+#ifdef WIN32
+  void *Mapping_ = nullptr;
+#endif
+};
+
+// Unbuffered read-only file, no stdio overhead
+class InputFile {
+public:
+  InputFile() {}
+  ~InputFile() { close(); }
+  InputFile(const InputFile&) = delete;
+  InputFile &operator=(const InputFile&) = delete;
+
+  bool open(const std::filesystem::path &path);
+  void close();
+  bool isOpen() const;
+
+  uint64_t size() const { return Size_; }
+  // bytesRead is 0 at end of file; returns false on error
+  bool read(void *buffer, size_t size, size_t *bytesRead);
+  // Reads until buffer is full or end of file
+  bool readFull(void *buffer, size_t size, size_t *bytesRead);
+
+private:
+#ifdef WIN32
+  void *Handle_ = nullptr;
+#else
+  int Fd_ = -1;
+#endif
+  uint64_t Size_ = 0;
+};
+
+// Read-write file with positional I/O; concurrent calls from several threads allowed
+class RandomAccessFile {
+public:
+  RandomAccessFile() {}
+  ~RandomAccessFile() { close(); }
+  RandomAccessFile(const RandomAccessFile&) = delete;
+  RandomAccessFile &operator=(const RandomAccessFile&) = delete;
+
+  // Creates file or truncates existing one
+  bool create(const std::filesystem::path &path);
+  bool close();
+  bool resize(uint64_t size);
+  bool readAt(uint64_t offset, void *buffer, size_t size);
+  bool writeAt(uint64_t offset, const void *data, size_t size);
+
+private:
+#ifdef WIN32
+  void *Handle_ = nullptr;
+#else
+  int Fd_ = -1;
+#endif
+};
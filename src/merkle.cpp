@@ -0,0 +1,189 @@
+#include "merkle.h"
+#include "sha3Tools.h"
+#include "strExtras.h"
+#include <fstream>
+
+static const char *MerkleHeader = "#cxx-pm-merkle v1";
+
+static std::string directoryDigest(const CMerkleNode &node)
+{
+  std::string concatenated;
+  for (const auto &[name, child] : node.Children)
+    concatenated += child.Digest;
+  return sha3StringHash(concatenated);
+}
+
+static CMerkleNode &merkleAddNode(CMerkleNode &root, const std::string &path)
+{
+  CMerkleNode *node = &root;
+#ifdef WIN32
+  StringSplitter splitter(path, "/\\");
+#else
+  StringSplitter splitter(path, "/");
+#endif
+  while (splitter.next()) {
+    std::string_view name = splitter.get();
+    if (name.empty())
+      continue;
+    node->IsDirectory = true;
+    node = &node->Children[std::string(name)];
+  }
+  return *node;
+}
+
+void merkleAddFile(CMerkleNode &root, const std::string &path, const std::string &digest)
+{
+  CMerkleNode &node = merkleAddNode(root, path);
+  node.Digest = digest;
+  node.IsDirectory = false;
+}
+
+void merkleUpdate(CMerkleNode &node)
+{
+  if (!node.IsDirectory)
+    return;
+  for (auto &[name, child] : node.Children)
+    merkleUpdate(child);
+  node.Digest = directoryDigest(node);
+}
+
+bool merkleBuild(const std::filesystem::path &path, const std::string &excludeFile, CMerkleNode &root)
+{
+  root.Children.clear();
+  if (!std::filesystem::is_directory(path)) {
+    root.IsDirectory = false;
+    root.Digest = sha3FileHash(path);
+    return !root.Digest.empty();
+  }
+
+  root.IsDirectory = true;
+  for (const auto &entry : std::filesystem::directory_iterator(path)) {
+    std::string name = entry.path().filename().string();
+    if (!excludeFile.empty() && name == excludeFile)
+      continue;
+    if (!merkleBuild(entry.path(), excludeFile, root.Children[name]))
+      return false;
+  }
+
+  root.Digest = directoryDigest(root);
+  return true;
+}
+
+static void merkleWrite(std::ofstream &file, const CMerkleNode &node, const std::string &path)
+{
+  for (const auto &[name, child] : node.Children) {
+    std::string childPath = path.empty() ? name : path + "/" + name;
+    file << (child.IsDirectory ? 'd' : 'f') << ' ' << child.Digest << ' ' << childPath << '\n';
+    merkleWrite(file, child, childPath);
+  }
+}
+
+bool merkleStore(const std::filesystem::path &path, const CMerkleNode &root)
+{
+  std::filesystem::path tmpPath = path;
+  tmpPath += ".tmp";
+  {
+    std::ofstream file(tmpPath, std::ios::binary);
+    if (!file) {
+      fprintf(stderr, "ERROR: can't write %s\n", tmpPath.string().c_str());
+      return false;
+    }
+    file << MerkleHeader << '\n';
+    merkleWrite(file, root, std::string());
+    if (!file) {
+      fprintf(stderr, "ERROR: can't write %s\n", tmpPath.string().c_str());
+      return false;
+    }
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(tmpPath, path, ec);
+  if (ec) {
+    fprintf(stderr, "ERROR: can't write %s\n", path.string().c_str());
+    return false;
+  }
+
+  return true;
+}
+
+static bool merkleCheck(const CMerkleNode &node)
+{
+  if (!node.IsDirectory)
+    return node.Children.empty();
+  for (const auto &[name, child] : node.Children) {
+    if (!merkleCheck(child))
+      return false;
+  }
+  return node.Digest == directoryDigest(node);
+}
+
+bool merkleLoad(const std::filesystem::path &path, CMerkleNode &root)
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    return false;
+
+  std::string line;
+  if (!std::getline(file, line) || line != MerkleHeader)
+    return false;
+
+  root = CMerkleNode();
+  root.IsDirectory = true;
+  while (std::getline(file, line)) {
+    // <d|f> <64 hex digits> <path>
+    if (line.size() < 68 || (line[0] != 'd' && line[0] != 'f') || line[1] != ' ' || line[66] != ' ')
+      return false;
+    CMerkleNode &node = merkleAddNode(root, line.substr(67));
+    if (&node == &root)
+      return false;
+    node.IsDirectory = line[0] == 'd';
+    node.Digest = line.substr(2, 64);
+  }
+
+  for (const auto &[name, child] : root.Children) {
+    if (!merkleCheck(child))
+      return false;
+  }
+
+  root.Digest = directoryDigest(root);
+  return true;
+}
+
+static void merkleDiffImpl(const CMerkleNode &left,
+                           const CMerkleNode &right,
+                           const std::string &path,
+                           std::vector<CMerkleDifference> &differences,
+                           size_t &compared)
+{
+  compared++;
+  if (left.Digest == right.Digest && left.IsDirectory == right.IsDirectory)
+    return;
+
+  if (!left.IsDirectory || !right.IsDirectory) {
+    differences.push_back(CMerkleDifference{path, EMerkleDifference::Changed});
+    return;
+  }
+
+  auto l = left.Children.begin();
+  auto r = right.Children.begin();
+  while (l != left.Children.end() || r != right.Children.end()) {
+    if (r == right.Children.end() || (l != left.Children.end() && l->first < r->first)) {
+      differences.push_back(CMerkleDifference{path.empty() ? l->first : path + "/" + l->first, EMerkleDifference::Removed});
+      ++l;
+    } else if (l == left.Children.end() || r->first < l->first) {
+      differences.push_back(CMerkleDifference{path.empty() ? r->first : path + "/" + r->first, EMerkleDifference::Added});
+      ++r;
+    } else {
+      merkleDiffImpl(l->second, r->second, path.empty() ? l->first : path + "/" + l->first, differences, compared);
+      ++l;
+      ++r;
+    }
+  }
+}
+
+size_t merkleDiff(const CMerkleNode &left, const CMerkleNode &right, std::vector<CMerkleDifference> &differences)
+{
+  size_t compared = 0;
+  merkleDiffImpl(left, right, std::string(), differences, compared);
+  return compared;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+// Merkle tree: digest of directory is SHA3 of concatenated digests of its children (hex, sorted by name),
+// same as sha3DirectoryHash, so digests of repository top level entries can be checked against MANIFEST
+// Text format (MANIFEST.tree): "<d|f> <sha3> <path>" for each node except root, paths separated by '/'
+static const char *const MERKLE_MANIFEST_FILENAME = "MANIFEST.tree";
+
+struct CMerkleNode {
+  std::string Digest;
+  bool IsDirectory = false;
+  std::map<std::string, CMerkleNode> Children;
+};
+
+enum class EMerkleDifference {
+  Added,
+  Removed,
+  Changed
+};
+
+struct CMerkleDifference {
+  std::string Path;
+  EMerkleDifference Type;
+};
+
+// Adds file with known digest and all its parent directories; call merkleUpdate after all files added
+void merkleAddFile(CMerkleNode &root, const std::string &path, const std::string &digest);
+// Computes digests of all directory nodes
+void merkleUpdate(CMerkleNode &node);
+
+// Hash file or directory, root digest is the same as sha3DirectoryHash(path, excludeFile) for directory
+bool merkleBuild(const std::filesystem::path &path, const std::string &excludeFile, CMerkleNode &root);
+
+bool merkleStore(const std::filesystem::path &path, const CMerkleNode &root);
+// Returns false if file is invalid or digest of some directory not matches its children
+bool merkleLoad(const std::filesystem::path &path, CMerkleNode &root);
+
+// Descends only into subtrees with different digests, returns number of compared nodes
+size_t merkleDiff(const CMerkleNode &left, const CMerkleNode &right, std::vector<CMerkleDifference> &differences);
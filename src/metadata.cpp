@@ -0,0 +1,311 @@
+#include "metadata.h"
+#include "exec.h"
+#include "os.h"
+#include "package.h"
+#include "sha3Tools.h"
+#include "json/json11.hpp"
+#include <string.h>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+// Build file can print anything while sourced; values printed after this marker separated by '\0'
+// (values can contain new lines, DEPENDS for example)
+static const char *VariablesMarker = "@CXXPM-VARIABLES@";
+
+static std::filesystem::path gCacheDirectory;
+
+struct CFileIdentity {
+  std::string Size;
+  std::string MTime;
+  std::string Hash;
+};
+
+static bool fileIdentity(const std::filesystem::path &path, CFileIdentity &identity)
+{
+  std::error_code ec;
+  auto size = std::filesystem::file_size(path, ec);
+  if (ec)
+    return false;
+  auto mtime = std::filesystem::last_write_time(path, ec);
+  if (ec)
+    return false;
+  identity.Size = std::to_string(size);
+  identity.MTime = std::to_string(mtime.time_since_epoch().count());
+  identity.Hash = sha3FileHash(path);
+  return !identity.Hash.empty();
+}
+
+// Files sourced by build file (common helpers), their changes invalidate cache entry too
+struct CSourcedFile {
+  std::string Path;
+  CFileIdentity Identity;
+};
+
+static std::filesystem::path cacheEntryPath(const std::filesystem::path &path, const std::vector<std::string> &names)
+{
+  std::string key = std::filesystem::absolute(path).string();
+  for (const auto &name: names) {
+    key.push_back('\n');
+    key.append(name);
+  }
+  return gCacheDirectory / (sha3StringHashBase64url(key, 15) + ".json");
+}
+
+static bool cacheLoad(const std::filesystem::path &path,
+                      const CFileIdentity &identity,
+                      const std::vector<std::string> &names,
+                      std::vector<std::string> &variables,
+                      std::vector<std::string> *sourcedFiles)
+{
+  std::ifstream file(cacheEntryPath(path, names));
+  if (!file)
+    return false;
+  std::stringstream content;
+  content << file.rdbuf();
+
+  std::string error;
+  auto json = json11::Json::parse(content.str(), error);
+  if (!error.empty() ||
+      json["path"].string_value() != std::filesystem::absolute(path).string() ||
+      json["size"].string_value() != identity.Size ||
+      json["mtime"].string_value() != identity.MTime ||
+      json["sha3"].string_value() != identity.Hash)
+    return false;
+
+  const auto &cachedNames = json["names"].array_items();
+  const auto &cachedValues = json["values"].array_items();
+  if (cachedNames.size() != names.size() || cachedValues.size() != names.size())
+    return false;
+  for (size_t i = 0; i < names.size(); i++) {
+    if (cachedNames[i].string_value() != names[i] || !cachedValues[i].is_string())
+      return false;
+  }
+
+  for (const auto &sourced: json["sourced"].array_items()) {
+    CFileIdentity current;
+    if (!fileIdentity(sourced["path"].string_value(), current) ||
+        sourced["size"].string_value() != current.Size ||
+        sourced["mtime"].string_value() != current.MTime ||
+        sourced["sha3"].string_value() != current.Hash)
+      return false;
+  }
+
+  for (const auto &v: cachedValues)
+    variables.push_back(v.string_value());
+  if (sourcedFiles) {
+    for (const auto &sourced: json["sourced"].array_items())
+      sourcedFiles->push_back(sourced["path"].string_value());
+  }
+  return true;
+}
+
+static void cacheStore(const std::filesystem::path &path,
+                       const CFileIdentity &identity,
+                       const std::vector<std::string> &names,
+                       const std::vector<std::string> &variables,
+                       const std::vector<CSourcedFile> &sourcedFiles)
+{
+  json11::Json::array sourced;
+  for (const auto &file: sourcedFiles) {
+    sourced.push_back(json11::Json::object {
+      {"path", file.Path},
+      {"size", file.Identity.Size},
+      {"mtime", file.Identity.MTime},
+      {"sha3", file.Identity.Hash}
+    });
+  }
+
+  json11::Json json = json11::Json::object {
+    {"path", std::filesystem::absolute(path).string()},
+    {"size", identity.Size},
+    {"mtime", identity.MTime},
+    {"sha3", identity.Hash},
+    {"names", names},
+    {"values", variables},
+    {"sourced", sourced}
+  };
+
+  // Write to temporary file and rename: other cxx-pm processes can read this entry right now
+  std::filesystem::path entryPath = cacheEntryPath(path, names);
+  std::filesystem::path tmpPath = entryPath;
+  tmpPath += "." + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) +
+             "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+  {
+    std::ofstream file(tmpPath);
+    if (!file)
+      return;
+    file << json.dump();
+    if (!file)
+      return;
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(tmpPath, entryPath, ec);
+  if (ec)
+    std::filesystem::remove(tmpPath, ec);
+}
+
+void metadataCacheSetDirectory(const std::filesystem::path &directory)
+{
+  std::error_code ec;
+  std::filesystem::create_directories(directory, ec);
+  gCacheDirectory = directory;
+}
+
+// 'source' and '.' wrapped to record absolute paths of sourced files, they are printed after variables
+static const char *SourceTracker =
+  "__cxxpm_sourced=(); "
+  "source() { if [[ $1 == /* ]]; then __cxxpm_sourced+=(\"$1\"); else __cxxpm_sourced+=(\"$PWD/$1\"); fi; builtin source \"$@\"; }; "
+  ".() { source \"$@\"; }; ";
+
+static bool loadVariablesImpl(const std::filesystem::path &path,
+                              const std::vector<std::string> &names,
+                              std::vector<std::string> &variables,
+                              std::vector<std::string> *sourcedFiles = nullptr)
+{
+  std::string capturedOut;
+  std::string capturedErr;
+  std::filesystem::path fullPath;
+  std::string args;
+
+  args = SourceTracker;
+  args.append("set -e; source ");
+  args.append(pathConvert(path, EPathType::Posix).string());
+  args.append("; printf '\\n");
+  args.append(VariablesMarker);
+  args.append("\\n'; printf '%s\\0'");
+  for (const auto &v: names) {
+    args.append(" \"$");
+    args.append(v);
+    args.append("\"");
+  }
+  // First element is build file itself
+  args.append("; printf '%s\\0' \"${__cxxpm_sourced[@]:1}\";");
+
+  if (!run(path.parent_path(), "bash", {"-c", args}, {}, fullPath, capturedOut, capturedErr, true)) {
+    if (!fullPath.empty())
+      fprintf(stderr, "%s\n", capturedErr.c_str());
+    return false;
+  }
+
+  std::string marker = std::string("\n") + VariablesMarker + "\n";
+  size_t pos = capturedOut.rfind(marker);
+  if (pos == std::string::npos)
+    return false;
+  pos += marker.size();
+
+  std::vector<std::string> values;
+  while (pos < capturedOut.size()) {
+    size_t end = capturedOut.find('\0', pos);
+    if (end == std::string::npos)
+      return false;
+    values.emplace_back(capturedOut, pos, end - pos);
+    pos = end + 1;
+  }
+
+  if (values.size() < names.size())
+    return false;
+  for (size_t i = 0; i < names.size(); i++)
+    variables.emplace_back(std::move(values[i]));
+  if (sourcedFiles) {
+    for (size_t i = names.size(); i < values.size(); i++) {
+      if (!values[i].empty())
+        sourcedFiles->push_back(pathConvert(values[i], EPathType::Native).lexically_normal().string());
+    }
+  }
+  return true;
+}
+
+bool loadVariables(const std::filesystem::path &path,
+                   const std::vector<std::string> &names,
+                   std::vector<std::string> &variables,
+                   std::vector<std::string> *sourcedFiles)
+{
+  CFileIdentity identity;
+  if (gCacheDirectory.empty() || !fileIdentity(path, identity))
+    return loadVariablesImpl(path, names, variables, sourcedFiles);
+
+  if (cacheLoad(path, identity, names, variables, sourcedFiles))
+    return true;
+
+  std::vector<std::string> loaded;
+  std::vector<std::string> sourcedPaths;
+  if (!loadVariablesImpl(path, names, loaded, &sourcedPaths))
+    return false;
+
+  // Entry not stored if sourced file can't be identified, it would be never invalidated
+  std::vector<CSourcedFile> sourcedIdentities(sourcedPaths.size());
+  bool cacheable = true;
+  for (size_t i = 0; i < sourcedPaths.size(); i++) {
+    sourcedIdentities[i].Path = sourcedPaths[i];
+    cacheable &= fileIdentity(sourcedPaths[i], sourcedIdentities[i].Identity);
+  }
+  if (cacheable)
+    cacheStore(path, identity, names, loaded, sourcedIdentities);
+  variables.insert(variables.end(), loaded.begin(), loaded.end());
+  if (sourcedFiles)
+    sourcedFiles->insert(sourcedFiles->end(), sourcedPaths.begin(), sourcedPaths.end());
+  return true;
+}
+
+bool loadSingleVariable(const std::filesystem::path &path, const std::string &name, std::string &variable)
+{
+  std::vector<std::string> variables;
+  if (!loadVariables(path, { name }, variables))
+    return false;
+  variable = std::move(variables[0]);
+  return true;
+}
+
+bool loadPackageMetadata(const std::filesystem::path &buildFile, const std::string &hostPrefix, CPackageMetadata &metadata)
+{
+  std::vector<std::string> names = {
+    "PACKAGE_TYPE",
+    "LANGS",
+    "TYPE",
+    "URL",
+    "SHA3",
+    "TAG",
+    "COMMIT",
+    hostPrefix + "TYPE",
+    hostPrefix + "URL",
+    hostPrefix + "SHA3",
+    hostPrefix + "TAG",
+    hostPrefix + "COMMIT",
+    "DEPENDS",
+    "DEPENDS_BINARY",
+    "K12",
+    hostPrefix + "K12",
+    "SIZE",
+    hostPrefix + "SIZE"
+  };
+
+  std::vector<std::string> variables;
+  metadata.SourcedFiles.clear();
+  if (!loadVariables(buildFile, names, variables, &metadata.SourcedFiles)) {
+    fprintf(stderr, "ERROR: can't load variables from %s\n", buildFile.string().c_str());
+    return false;
+  }
+
+  metadata.PackageType = std::move(variables[0]);
+  metadata.Langs = std::move(variables[1]);
+  metadata.Type = std::move(variables[2]);
+  metadata.Url = std::move(variables[3]);
+  metadata.Sha3 = std::move(variables[4]);
+  metadata.Tag = std::move(variables[5]);
+  metadata.Commit = std::move(variables[6]);
+  metadata.HostType = std::move(variables[7]);
+  metadata.HostUrl = std::move(variables[8]);
+  metadata.HostSha3 = std::move(variables[9]);
+  metadata.HostTag = std::move(variables[10]);
+  metadata.HostCommit = std::move(variables[11]);
+  metadata.Depends = std::move(variables[12]);
+  metadata.DependsBinary = std::move(variables[13]);
+  metadata.K12 = std::move(variables[14]);
+  metadata.HostK12 = std::move(variables[15]);
+  metadata.Size = std::move(variables[16]);
+  metadata.HostSize = std::move(variables[17]);
+  return true;
+}
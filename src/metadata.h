@@ -0,0 +1,22 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+struct CPackageMetadata;
+
+// Enable persistent cache of loaded variables, keyed by file path, size, mtime and content hash;
+// files sourced by build file are checked the same way
+void metadataCacheSetDirectory(const std::filesystem::path &directory);
+
+// Source bash file and capture values of variables; 'sourcedFiles' receives files sourced by it
+bool loadVariables(const std::filesystem::path &path,
+                   const std::vector<std::string> &names,
+                   std::vector<std::string> &variables,
+                   std::vector<std::string> *sourcedFiles = nullptr);
+bool loadSingleVariable(const std::filesystem::path &path, const std::string &name, std::string &variable);
+
+// Source package build file once and capture all variables used by cxx-pm
+// hostPrefix is a prefix of binary distribution variables, like "Linux_x86_64_"
+bool loadPackageMetadata(const std::filesystem::path &buildFile, const std::string &hostPrefix, CPackageMetadata &metadata);
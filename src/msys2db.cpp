@@ -3,6 +3,7 @@
 #include "httpdownload.h"
 #include "hex.h"
 #include "exec.h"
+#include "parallel.h"
 extern "C" {
 #include "sha256.h"
 }
@@ -11,7 +12,6 @@ extern "C" {
 #include <string.h>
 #include <unordered_set>
 #include <algorithm>
-#include <future>
 
 static bool zstdDecompressBuffer(const std::vector<uint8_t> &compressed, std::vector<uint8_t> &decompressed);
 
@@ -209,10 +209,10 @@ static bool writeFile(const std::filesystem::path &path, const std::vector<uint8
   return wr == data.size();
 }
 
-static std::string sha256hex(const void *data, size_t size)
+static std::string sha256FinalHex(CCtxSha256 &ctx)
 {
   uint8_t hash[32];
-  sha256(data, size, hash);
+  sha256Final(&ctx, hash);
   char hex[65] = {0};
   bin2hexLowerCase(hash, hex, 32);
   return hex;
@@ -252,6 +252,9 @@ bool msys2Install(const std::filesystem::path &installDir,
   const size_t maxBatchBytes = 256 * 1024 * 1024; // 256 MB memory budget per batch
 
   static const std::string MSYS2_REPO = "https://repo.msys2.org/msys/x86_64/";
+  // Requests of all steps share keep-alive connections
+  const unsigned maxConnections = 8;
+  HttpClient client;
 
   std::error_code ec;
   std::filesystem::path sigDir = installDir / "msys2.sig";
@@ -263,7 +266,7 @@ bool msys2Install(const std::filesystem::path &installDir,
     printf("Checking msys2 package database...\n");
     fflush(stdout);
     std::vector<uint8_t> remoteSig;
-    if (!httpDownloadToMemory(MSYS2_REPO + "msys.db.sig", remoteSig)) {
+    if (!client.downloadToMemory(MSYS2_REPO + "msys.db.sig", remoteSig)) {
       fprintf(stderr, "ERROR: failed to download msys.db.sig\n");
       return false;
     }
@@ -280,7 +283,7 @@ bool msys2Install(const std::filesystem::path &installDir,
     if (!cached) {
       printf("Downloading msys2 package database...\n");
       fflush(stdout);
-      if (!httpDownloadToMemory(MSYS2_REPO + "msys.db", dbData)) {
+      if (!client.downloadToMemory(MSYS2_REPO + "msys.db", dbData)) {
         fprintf(stderr, "ERROR: failed to download msys.db\n");
         return false;
       }
@@ -315,36 +318,23 @@ bool msys2Install(const std::filesystem::path &installDir,
   std::vector<PkgSigResult> sigResults(resolved.size());
   std::vector<bool> needsInstall(resolved.size(), false);
 
-  const size_t maxSigConcurrent = 32;
   printf("Checking package signatures...\n");
   fflush(stdout);
-  for (size_t batch = 0; batch < resolved.size(); batch += maxSigConcurrent) {
-    size_t batchEnd = std::min(batch + maxSigConcurrent, resolved.size());
-    std::vector<std::future<PkgSigResult>> futures;
-
-    for (size_t i = batch; i < batchEnd; i++) {
-      std::string url = MSYS2_REPO + resolved[i]->Filename + ".sig";
-      futures.push_back(std::async(std::launch::async, [url]() -> PkgSigResult {
-        PkgSigResult r;
-        r.ok = httpDownloadToMemory(url, r.sig);
-        return r;
-      }));
-    }
-
-    for (size_t j = 0; j < futures.size(); j++) {
-      size_t i = batch + j;
-      sigResults[i] = futures[j].get();
-      if (!sigResults[i].ok) {
-        fprintf(stderr, "ERROR: failed to download %s.sig\n", resolved[i]->Filename.c_str());
-        return false;
-      }
+  bool sigsDownloaded = parallelFor(resolved.size(), maxConnections, [&](size_t i) -> bool {
+    sigResults[i].ok = client.downloadToMemory(MSYS2_REPO + resolved[i]->Filename + ".sig", sigResults[i].sig);
+    if (!sigResults[i].ok)
+      fprintf(stderr, "ERROR: failed to download %s.sig\n", resolved[i]->Filename.c_str());
+    return sigResults[i].ok;
+  });
+  if (!sigsDownloaded)
+    return false;
 
-      std::vector<uint8_t> localSig;
-      if (readFile(sigDir / (resolved[i]->Filename + ".sig"), localSig) && localSig == sigResults[i].sig) {
-        // up to date
-      } else {
-        needsInstall[i] = true;
-      }
+  for (size_t i = 0; i < resolved.size(); i++) {
+    std::vector<uint8_t> localSig;
+    if (readFile(sigDir / (resolved[i]->Filename + ".sig"), localSig) && localSig == sigResults[i].sig) {
+      // up to date
+    } else {
+      needsInstall[i] = true;
     }
   }
 
@@ -363,6 +353,8 @@ bool msys2Install(const std::filesystem::path &installDir,
   struct PkgDownloadResult {
     size_t index;
     std::vector<uint8_t> data;
+    // Computed while downloading
+    std::string sha256;
     bool ok;
   };
 
@@ -381,12 +373,9 @@ bool msys2Install(const std::filesystem::path &installDir,
       batchEnd++;
     }
 
-    std::vector<std::future<PkgDownloadResult>> futures;
-
-    // Print and launch downloads
+    // Print batch
     for (size_t b = pos; b < batchEnd; b++) {
-      size_t idx = installIndices[b];
-      const auto &pkg = *resolved[idx];
+      const auto &pkg = *resolved[installIndices[b]];
       dlCount++;
       if (pkg.CompressedSize >= 1024 * 1024)
         printf("  [%zu/%zu] downloading %s-%s (%.1f MB)\n", dlCount, toInstall,
@@ -394,24 +383,30 @@ bool msys2Install(const std::filesystem::path &installDir,
       else
         printf("  [%zu/%zu] downloading %s-%s (%.1f KB)\n", dlCount, toInstall,
                pkg.Name.c_str(), pkg.Version.c_str(), pkg.CompressedSize / 1024.0);
-      fflush(stdout);
-      std::string url = MSYS2_REPO + pkg.Filename;
-      futures.push_back(std::async(std::launch::async, [url, idx]() -> PkgDownloadResult {
-        PkgDownloadResult r;
-        r.index = idx;
-        r.ok = httpDownloadToMemory(url, r.data);
-        return r;
-      }));
     }
+    fflush(stdout);
 
-    // Wait for all downloads, collect results
-    std::vector<PkgDownloadResult> results;
-    for (auto &f : futures)
-      results.push_back(f.get());
-
-    // Sort by original index to maintain dependency order for extraction
-    std::sort(results.begin(), results.end(),
-              [](const PkgDownloadResult &a, const PkgDownloadResult &b) { return a.index < b.index; });
+    // Results in dependency order; failed download reported during extraction
+    std::vector<PkgDownloadResult> results(batchEnd - pos);
+    for (size_t j = 0; j < results.size(); j++) {
+      results[j].index = installIndices[pos + j];
+      results[j].ok = false;
+    }
+    parallelFor(results.size(), maxConnections, [&](size_t j) -> bool {
+      PkgDownloadResult &r = results[j];
+      const auto &pkg = *resolved[r.index];
+      CCtxSha256 ctx;
+      sha256Init(&ctx);
+      r.data.reserve(pkg.CompressedSize);
+      r.ok = client.download(MSYS2_REPO + pkg.Filename, [&r, &ctx](const uint8_t *data, size_t size) {
+        r.data.insert(r.data.end(), data, data + size);
+        sha256Update(&ctx, data, size);
+        return true;
+      }, pkg.CompressedSize);
+      if (r.ok)
+        r.sha256 = sha256FinalHex(ctx);
+      return r.ok;
+    });
 
     // Extract sequentially in dependency order
     for (auto &r : results) {
@@ -427,10 +422,9 @@ bool msys2Install(const std::filesystem::path &installDir,
 
       // Verify SHA256
       if (!pkg.Sha256.empty()) {
-        std::string hash = sha256hex(r.data.data(), r.data.size());
-        if (hash != pkg.Sha256) {
+        if (r.sha256 != pkg.Sha256) {
           fprintf(stderr, "ERROR: SHA256 mismatch for %s\n  expected: %s\n  got:      %s\n",
-                  pkg.Filename.c_str(), pkg.Sha256.c_str(), hash.c_str());
+                  pkg.Filename.c_str(), pkg.Sha256.c_str(), r.sha256.c_str());
           return false;
         }
       }
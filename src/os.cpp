@@ -3,10 +3,12 @@
 #include "exec.h"
 #include "strExtras.h"
 #include <algorithm>
+#include <atomic>
 
 #ifdef WIN32
 #include <Windows.h>
 #else
+#include <sys/stat.h>
 #include <unistd.h>
 #endif
 
@@ -290,3 +292,47 @@ std::filesystem::path whereami(const char *argv0)
   return std::filesystem::exists(result) ? result : std::filesystem::path();
 #endif
 }
+
+bool fileStat(const std::filesystem::path &path, CFileStat &stat)
+{
+#ifdef WIN32
+  HANDLE handle = CreateFileW(path.c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+  if (handle == INVALID_HANDLE_VALUE)
+    return false;
+  BY_HANDLE_FILE_INFORMATION info;
+  bool result = GetFileInformationByHandle(handle, &info);
+  CloseHandle(handle);
+  if (!result)
+    return false;
+  stat.Size = (static_cast<uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+  // FILETIME: 100ns intervals since 1601-01-01
+  uint64_t fileTime = (static_cast<uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32) | info.ftLastWriteTime.dwLowDateTime;
+  stat.MTime = (static_cast<int64_t>(fileTime) - 116444736000000000LL) * 100;
+  stat.Inode = (static_cast<uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+#else
+  struct stat st;
+  if (::stat(path.c_str(), &st) != 0)
+    return false;
+  stat.Size = st.st_size;
+#ifdef __APPLE__
+  stat.MTime = static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+  stat.MTime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+  stat.Inode = st.st_ino;
+#endif
+  return true;
+}
+
+std::filesystem::path uniqueTempPath(const std::filesystem::path &path)
+{
+  static std::atomic<uint64_t> counter = 0;
+#ifdef WIN32
+  uint64_t pid = GetCurrentProcessId();
+#else
+  uint64_t pid = static_cast<uint64_t>(getpid());
+#endif
+  std::filesystem::path tmpPath = path;
+  tmpPath += "." + std::to_string(pid) + "." + std::to_string(counter.fetch_add(1)) + ".tmp";
+  return tmpPath;
+}
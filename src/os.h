@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdint.h>
 #include <filesystem>
 #include <string>
 #include <vector>
@@ -38,6 +39,14 @@ struct CSystemInfo {
   std::filesystem::path ISysRoot;
 };
 
+struct CFileStat {
+  uint64_t Size = 0;
+  // Modification time in nanoseconds since epoch
+  int64_t MTime = 0;
+  // Inode number (file index on Windows)
+  uint64_t Inode = 0;
+};
+
 std::string systemProcessorNormalize(const std::string_view processor);
 std::string osGetSystemName();
 std::string osGetSystemProcessor();
@@ -49,3 +58,6 @@ bool doBuildTypeMapping(const std::string &buildType, const std::string &mapping
 void uniqueBuildTypes(const std::vector<CBuildType> &in, std::vector<std::string> &out);
 std::filesystem::path userHomeDir();
 std::filesystem::path whereami(const char *argv0);
+bool fileStat(const std::filesystem::path &path, CFileStat &stat);
+// Temporary file name next to 'path', unique across processes and threads (write it, then rename to 'path')
+std::filesystem::path uniqueTempPath(const std::filesystem::path &path);
@@ -105,6 +105,17 @@ std::filesystem::path packagePrefix(const std::filesystem::path &cxxPmHome, cons
   }
 }
 
+std::filesystem::path packageSourceDir(const std::filesystem::path &cxxPmHome, const CPackage &package)
+{
+  // Short id instead of full prefix keeps source tree paths short (Windows MAX_PATH)
+  return cxxPmHome / ".s" / sha3StringHashBase64url(package.Prefix.string(), 9);
+}
+
+std::filesystem::path packageBuildDir(const std::filesystem::path &cxxPmHome, const CPackage &package)
+{
+  return cxxPmHome / ".b" / sha3StringHashBase64url(package.Prefix.string(), 9);
+}
+
 static void addEnv(std::vector<std::string> &env, const std::string &name, const std::string &value)
 {
   env.emplace_back(name);
@@ -423,8 +434,8 @@ void prepareBuildEnvironment(std::vector<std::string> &env,
 #endif
 
   // Directories
-  addEnv(env, "CXXPM_SOURCE_DIR", pathConvert(globalSettings.HomeDir / ".s", envPathType).string());
-  addEnv(env, "CXXPM_BUILD_DIR", pathConvert(globalSettings.HomeDir / ".b", envPathType).string());
+  addEnv(env, "CXXPM_SOURCE_DIR", pathConvert(packageSourceDir(globalSettings.HomeDir, package), envPathType).string());
+  addEnv(env, "CXXPM_BUILD_DIR", pathConvert(packageBuildDir(globalSettings.HomeDir, package), envPathType).string());
   addEnv(env, "CXXPM_INSTALL_DIR", pathConvert(package.Prefix / "install", envPathType).string());
   addEnv(env, "CXXPM_PACKAGE_DIR", pathConvert(package.BuildFile.parent_path(), envPathType).string());
 
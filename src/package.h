@@ -8,16 +8,56 @@ class Json;
 
 struct CxxPmSettings;
 
+// Variables of package build file, loaded by single bash run
+struct CPackageMetadata {
+  std::string PackageType;
+  std::string Langs;
+  // Source distribution
+  std::string Type;
+  std::string Url;
+  std::string Sha3;
+  // KangarooTwelve hash, can be used instead of SHA3 for large archives
+  std::string K12;
+  // Archive size in bytes, optional: lets download abort as soon as server sends other size
+  std::string Size;
+  std::string Tag;
+  std::string Commit;
+  // Binary distribution for host system (${HostSystemName}_${HostSystemProcessor}_ prefixed variables)
+  std::string HostType;
+  std::string HostUrl;
+  std::string HostSha3;
+  std::string HostK12;
+  std::string HostSize;
+  std::string HostTag;
+  std::string HostCommit;
+  // Dependencies
+  std::string Depends;
+  std::string DependsBinary;
+  // Files sourced by build file (common helpers), can define any of variables above
+  std::vector<std::string> SourcedFiles;
+};
+
+struct CIndexedVersion {
+  std::string Version;
+  std::string Depends;
+  std::string DependsBinary;
+};
+
 struct CPackage {
   std::string Name;
   std::filesystem::path Path;
   std::vector<std::filesystem::path> ExtraPath;
+  // This members fill from repository index (for packages in main repository only)
+  bool Indexed = false;
+  std::string IndexedDefaultVersion;
+  std::vector<CIndexedVersion> IndexedVersions;
   // This members fill by inspect function
   std::string Version;
   bool IsBinary;
   std::filesystem::path Prefix;
   std::filesystem::path BuildFile;
   std::vector<ELanguage> Languages;
+  CPackageMetadata Metadata;
 };
 
 enum class EArtifactType : unsigned {
@@ -51,6 +91,9 @@ struct CArtifact {
 };
 
 std::filesystem::path packagePrefix(const std::filesystem::path &cxxPmHome, const CPackage &package, const CompilersArray &compilers, const CSystemInfo &systemInfo, const std::string &buildType, bool verbose);
+// Scratch directories unique for each package prefix
+std::filesystem::path packageSourceDir(const std::filesystem::path &cxxPmHome, const CPackage &package);
+std::filesystem::path packageBuildDir(const std::filesystem::path &cxxPmHome, const CPackage &package);
 
 
 void prepareBuildEnvironment(std::vector<std::string> &env,
@@ -0,0 +1,97 @@
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+bool dagRun(const std::vector<std::vector<size_t>> &depends, unsigned jobs, const std::function<bool(size_t)> &task)
+{
+  size_t nodesNum = depends.size();
+  std::vector<std::vector<size_t>> dependents(nodesNum);
+  std::vector<size_t> remaining(nodesNum, 0);
+  std::deque<size_t> ready;
+  for (size_t i = 0; i < nodesNum; i++) {
+    remaining[i] = depends[i].size();
+    for (size_t d: depends[i])
+      dependents[d].push_back(i);
+    if (remaining[i] == 0)
+      ready.push_back(i);
+  }
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  size_t running = 0;
+  size_t finished = 0;
+  bool failed = false;
+
+  auto worker = [&]() {
+    std::unique_lock lock(mutex);
+    for (;;) {
+      cv.wait(lock, [&]() { return failed || !ready.empty() || running == 0; });
+      if (failed || ready.empty())
+        break;
+
+      size_t node = ready.front();
+      ready.pop_front();
+      running++;
+      lock.unlock();
+      bool result = task(node);
+      lock.lock();
+      running--;
+      finished++;
+
+      if (result) {
+        for (size_t d: dependents[node]) {
+          if (--remaining[d] == 0)
+            ready.push_back(d);
+        }
+      } else {
+        failed = true;
+      }
+
+      cv.notify_all();
+    }
+  };
+
+  if (jobs == 0)
+    jobs = 1;
+  size_t threadsNum = std::min<size_t>(jobs, nodesNum);
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < threadsNum; i++)
+    threads.emplace_back(worker);
+  worker();
+  for (auto &thread: threads)
+    thread.join();
+
+  return !failed && finished == nodesNum;
+}
+
+bool parallelFor(size_t count, unsigned jobs, const std::function<bool(size_t)> &task)
+{
+  std::atomic<size_t> next = 0;
+  std::atomic<bool> failed = false;
+
+  auto worker = [&]() {
+    while (!failed.load(std::memory_order_relaxed)) {
+      size_t index = next.fetch_add(1, std::memory_order_relaxed);
+      if (index >= count)
+        break;
+      if (!task(index))
+        failed = true;
+    }
+  };
+
+  if (jobs == 0)
+    jobs = 1;
+  size_t threadsNum = std::min<size_t>(jobs, count);
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < threadsNum; i++)
+    threads.emplace_back(worker);
+  worker();
+  for (auto &thread: threads)
+    thread.join();
+
+  return !failed;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Run tasks of a directed acyclic graph on a pool of worker threads
+// depends[i] contains indices of nodes which must be finished before node i starts
+// After first failed task no new tasks started, function waits running tasks and returns false
+bool dagRun(const std::vector<std::vector<size_t>> &depends, unsigned jobs, const std::function<bool(size_t)> &task);
+
+// Run task for each index in [0, count) on a pool of worker threads, indices are taken in increasing order
+// After first failed task no new tasks started, function waits running tasks and returns false
+bool parallelFor(size_t count, unsigned jobs, const std::function<bool(size_t)> &task);
+
+// Blocking queue with limited capacity, connects producer and worker threads
+template<typename T>
+class BoundedQueue {
+public:
+  BoundedQueue(size_t capacity) : Capacity_(capacity) {}
+
+  // Blocks while queue is full; returns false if queue closed
+  bool push(T value) {
+    std::unique_lock lock(Mutex_);
+    NotFull_.wait(lock, [this]() { return Closed_ || Queue_.size() < Capacity_; });
+    if (Closed_)
+      return false;
+    Queue_.push_back(std::move(value));
+    NotEmpty_.notify_one();
+    return true;
+  }
+
+  // Blocks while queue is empty; returns false if queue closed and all elements taken
+  bool pop(T &value) {
+    std::unique_lock lock(Mutex_);
+    NotEmpty_.wait(lock, [this]() { return Closed_ || !Queue_.empty(); });
+    if (Queue_.empty())
+      return false;
+    value = std::move(Queue_.front());
+    Queue_.pop_front();
+    NotFull_.notify_one();
+    return true;
+  }
+
+  // No more elements will be pushed
+  void close() {
+    std::unique_lock lock(Mutex_);
+    Closed_ = true;
+    NotEmpty_.notify_all();
+    NotFull_.notify_all();
+  }
+
+private:
+  std::mutex Mutex_;
+  std::condition_variable NotEmpty_;
+  std::condition_variable NotFull_;
+  std::deque<T> Queue_;
+  size_t Capacity_;
+  bool Closed_ = false;
+};
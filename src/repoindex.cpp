@@ -0,0 +1,149 @@
+#include "repoindex.h"
+#include "lockfile.h"
+#include "manifest.h"
+#include "metadata.h"
+#include "package.h"
+#include "sha3Tools.h"
+#include "json/json11.hpp"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+static const int IndexFormatVersion = 2;
+
+std::filesystem::path repositoryIndexPath(const std::filesystem::path &cxxpmRoot)
+{
+  // Stored outside of packages directory: it's not a part of repository and must not break MANIFEST verification
+  return cxxpmRoot / "packages.index";
+}
+
+bool repositoryIndexBuild(const std::filesystem::path &packagesDir, const std::filesystem::path &indexPath)
+{
+  std::string manifestHash = sha3FileHash(packagesDir / MANIFEST_FILENAME);
+  if (manifestHash.empty()) {
+    fprintf(stderr, "ERROR: failed to compute manifest hash\n");
+    return false;
+  }
+
+  std::vector<std::filesystem::path> packageDirs;
+  for (const auto &folder: std::filesystem::directory_iterator{packagesDir}) {
+    std::string name = folder.path().filename().string();
+    if (name.empty() || name[0] == '.' || name == MANIFEST_FILENAME || name == SIGN_FILENAME || !folder.is_directory())
+      continue;
+    packageDirs.push_back(folder.path());
+  }
+  std::sort(packageDirs.begin(), packageDirs.end());
+
+  json11::Json::object packages;
+  for (const auto &dir: packageDirs) {
+    std::string defaultVersion;
+    if (std::filesystem::exists(dir / "meta.build") && !loadSingleVariable(dir / "meta.build", "DEFAULT_VERSION", defaultVersion)) {
+      fprintf(stderr, "ERROR: can't load DEFAULT_VERSION from %s\n", (dir / "meta.build").string().c_str());
+      return false;
+    }
+
+    json11::Json::object versions;
+    for (const auto &entry: std::filesystem::directory_iterator(dir)) {
+      std::string filename = entry.path().filename().string();
+      if (filename.size() <= 6 || filename.substr(filename.size() - 6) != ".build" || filename == "meta.build")
+        continue;
+
+      std::vector<std::string> variables;
+      if (!loadVariables(entry.path(), {"DEPENDS", "DEPENDS_BINARY"}, variables)) {
+        fprintf(stderr, "ERROR: can't load variables from %s\n", entry.path().string().c_str());
+        return false;
+      }
+
+      versions[filename.substr(0, filename.size() - 6)] = json11::Json::object {
+        {"stamp", fileStamp(entry.path())},
+        {"depends", variables[0]},
+        {"depends_binary", variables[1]}
+      };
+    }
+
+    packages[dir.filename().string()] = json11::Json::object {
+      {"stamp", fileStamp(dir)},
+      {"meta", fileStamp(dir / "meta.build")},
+      {"default", defaultVersion},
+      {"versions", versions}
+    };
+  }
+
+  json11::Json json = json11::Json::object {
+    {"format", IndexFormatVersion},
+    {"manifest", manifestHash},
+    {"stamp", fileStamp(packagesDir)},
+    {"packages", packages}
+  };
+
+  std::filesystem::path tmpPath = indexPath;
+  tmpPath += ".tmp";
+  {
+    std::ofstream file(tmpPath);
+    if (!file) {
+      fprintf(stderr, "ERROR: can't write %s\n", tmpPath.string().c_str());
+      return false;
+    }
+    file << json.dump();
+    if (!file) {
+      fprintf(stderr, "ERROR: can't write %s\n", tmpPath.string().c_str());
+      return false;
+    }
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(tmpPath, indexPath, ec);
+  if (ec) {
+    fprintf(stderr, "ERROR: can't write %s\n", indexPath.string().c_str());
+    return false;
+  }
+
+  printf("Repository index updated: %zu packages\n", packages.size());
+  return true;
+}
+
+bool repositoryIndexLoad(const std::filesystem::path &packagesDir, const std::filesystem::path &indexPath, std::map<std::string, CPackage> &packages)
+{
+  std::ifstream file(indexPath);
+  if (!file)
+    return false;
+  std::stringstream content;
+  content << file.rdbuf();
+
+  std::string error;
+  auto json = json11::Json::parse(content.str(), error);
+  if (!error.empty() ||
+      json["format"].int_value() != IndexFormatVersion ||
+      !json["packages"].is_object())
+    return false;
+
+  // Index is valid only for repository state it was built from: MANIFEST changes with pulled updates,
+  // local edits (not reflected in MANIFEST) detected by stamps of package directories and build files;
+  // directory stamp changes when build files added or removed
+  if (json["manifest"].string_value() != sha3FileHash(packagesDir / MANIFEST_FILENAME) ||
+      json["stamp"].string_value() != fileStamp(packagesDir))
+    return false;
+
+  std::map<std::string, CPackage> result;
+  for (const auto &[name, item]: json["packages"].object_items()) {
+    CPackage package;
+    package.Name = name;
+    package.Path = packagesDir / name;
+    package.Indexed = true;
+    package.IndexedDefaultVersion = item["default"].string_value();
+    if (item["stamp"].string_value() != fileStamp(package.Path) || item["meta"].string_value() != fileStamp(package.Path / "meta.build"))
+      return false;
+    for (const auto &[version, versionItem]: item["versions"].object_items()) {
+      if (versionItem["stamp"].string_value() != fileStamp(package.Path / (version + ".build")))
+        return false;
+      CIndexedVersion &indexed = package.IndexedVersions.emplace_back();
+      indexed.Version = version;
+      indexed.Depends = versionItem["depends"].string_value();
+      indexed.DependsBinary = versionItem["depends_binary"].string_value();
+    }
+    result.insert(std::make_pair(name, std::move(package)));
+  }
+
+  packages.insert(result.begin(), result.end());
+  return true;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <filesystem>
+#include <map>
+#include <string>
+
+struct CPackage;
+
+// Repository index: packages, versions, default versions and dependencies of main package repository
+// Index bound to MANIFEST of repository by its hash and to size/mtime of package directories and build files,
+// so local edits make it outdated until next --update
+
+std::filesystem::path repositoryIndexPath(const std::filesystem::path &cxxpmRoot);
+
+// Source all build files of repository and write index, called after successful --update
+bool repositoryIndexBuild(const std::filesystem::path &packagesDir, const std::filesystem::path &indexPath);
+
+// Load packages from index; returns false if index not exists or not matches current repository state
+bool repositoryIndexLoad(const std::filesystem::path &packagesDir, const std::filesystem::path &indexPath, std::map<std::string, CPackage> &packages);
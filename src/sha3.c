@@ -18,7 +18,7 @@ static const uint32_t KeccakConstants800[22] = {
   0x00008080,
 };
 
-static uint64_t KeccakConstants1600[24] = {
+const uint64_t sha3llRoundConstants1600[24] = {
     0x0000000000000001, 0x0000000000008082, 0x800000000000808a,
     0x8000000080008000, 0x000000000000808b, 0x0000000080000001,
     0x8000000080008081, 0x8000000000008009, 0x000000000000008a,
@@ -289,14 +289,291 @@ void sha3llRound1600(uint64_t state[25], unsigned round)
   }
 
   //  Iota
-  state[0] ^= KeccakConstants1600[round];
+  state[0] ^= sha3llRoundConstants1600[round];
 }
 
+// Optimized permutation: state in local variables, all 24 rounds unrolled
+// Chi step variants:
+//   plain: a ^ (~b & c), single ANDN instruction with BMI (x86) or BIC (ARM)
+//   lane complementing: lanes 1, 2, 8, 12, 17, 20 kept inverted, so chi needs only one NOT per row
+#define CHI_PLAIN_ROW(E, r, b0, b1, b2, b3, b4) \
+  E##r##a = b0 ^ (~b1 & b2); \
+  E##r##e = b1 ^ (~b2 & b3); \
+  E##r##i = b2 ^ (~b3 & b4); \
+  E##r##o = b3 ^ (~b4 & b0); \
+  E##r##u = b4 ^ (~b0 & b1);
+
+#define CHI_PLAIN_b(E, b0, b1, b2, b3, b4) CHI_PLAIN_ROW(E, b, b0, b1, b2, b3, b4)
+#define CHI_PLAIN_g(E, b0, b1, b2, b3, b4) CHI_PLAIN_ROW(E, g, b0, b1, b2, b3, b4)
+#define CHI_PLAIN_k(E, b0, b1, b2, b3, b4) CHI_PLAIN_ROW(E, k, b0, b1, b2, b3, b4)
+#define CHI_PLAIN_m(E, b0, b1, b2, b3, b4) CHI_PLAIN_ROW(E, m, b0, b1, b2, b3, b4)
+#define CHI_PLAIN_s(E, b0, b1, b2, b3, b4) CHI_PLAIN_ROW(E, s, b0, b1, b2, b3, b4)
+
+#define CHI_COMPLEMENT_b(E, b0, b1, b2, b3, b4) \
+  E##ba = b0 ^ (b1 | b2); \
+  E##be = b1 ^ (~b2 | b3); \
+  E##bi = b2 ^ (b3 & b4); \
+  E##bo = b3 ^ (b4 | b0); \
+  E##bu = b4 ^ (b0 & b1);
+
+#define CHI_COMPLEMENT_g(E, b0, b1, b2, b3, b4) \
+  E##ga = b0 ^ (b1 | b2); \
+  E##ge = b1 ^ (b2 & b3); \
+  E##gi = b2 ^ (b3 | ~b4); \
+  E##go = b3 ^ (b4 | b0); \
+  E##gu = b4 ^ (b0 & b1);
+
+#define CHI_COMPLEMENT_k(E, b0, b1, b2, b3, b4) \
+  E##ka = b0 ^ (b1 | b2); \
+  E##ke = b1 ^ (b2 & b3); \
+  E##ki = b2 ^ (~b3 & b4); \
+  E##ko = ~b3 ^ (b4 | b0); \
+  E##ku = b4 ^ (b0 & b1);
+
+#define CHI_COMPLEMENT_m(E, b0, b1, b2, b3, b4) \
+  E##ma = b0 ^ (b1 & b2); \
+  E##me = b1 ^ (b2 | b3); \
+  E##mi = b2 ^ (~b3 | b4); \
+  E##mo = ~b3 ^ (b4 & b0); \
+  E##mu = b4 ^ (b0 | b1);
+
+#define CHI_COMPLEMENT_s(E, b0, b1, b2, b3, b4) \
+  E##sa = b0 ^ (~b1 & b2); \
+  E##se = ~b1 ^ (b2 | b3); \
+  E##si = b2 ^ (b3 & b4); \
+  E##so = b3 ^ (b4 | b0); \
+  E##su = b4 ^ (b0 & b1);
+
+// Theta, Rho, Pi, Chi and Iota of round from state A to state E
+#define KECCAK_ROUND(A, E, round, CHI) \
+  { \
+    uint64_t Ca = A##ba ^ A##ga ^ A##ka ^ A##ma ^ A##sa; \
+    uint64_t Ce = A##be ^ A##ge ^ A##ke ^ A##me ^ A##se; \
+    uint64_t Ci = A##bi ^ A##gi ^ A##ki ^ A##mi ^ A##si; \
+    uint64_t Co = A##bo ^ A##go ^ A##ko ^ A##mo ^ A##so; \
+    uint64_t Cu = A##bu ^ A##gu ^ A##ku ^ A##mu ^ A##su; \
+    uint64_t Da = Cu ^ rol64(Ce, 1); \
+    uint64_t De = Ca ^ rol64(Ci, 1); \
+    uint64_t Di = Ce ^ rol64(Co, 1); \
+    uint64_t Do = Ci ^ rol64(Cu, 1); \
+    uint64_t Du = Co ^ rol64(Ca, 1); \
+    uint64_t B0, B1, B2, B3, B4; \
+    B0 = A##ba ^ Da; \
+    B1 = rol64(A##ge ^ De, 44); \
+    B2 = rol64(A##ki ^ Di, 43); \
+    B3 = rol64(A##mo ^ Do, 21); \
+    B4 = rol64(A##su ^ Du, 14); \
+    CHI##_b(E, B0, B1, B2, B3, B4) \
+    E##ba ^= sha3llRoundConstants1600[round]; \
+    B0 = rol64(A##bo ^ Do, 28); \
+    B1 = rol64(A##gu ^ Du, 20); \
+    B2 = rol64(A##ka ^ Da, 3); \
+    B3 = rol64(A##me ^ De, 45); \
+    B4 = rol64(A##si ^ Di, 61); \
+    CHI##_g(E, B0, B1, B2, B3, B4) \
+    B0 = rol64(A##be ^ De, 1); \
+    B1 = rol64(A##gi ^ Di, 6); \
+    B2 = rol64(A##ko ^ Do, 25); \
+    B3 = rol64(A##mu ^ Du, 8); \
+    B4 = rol64(A##sa ^ Da, 18); \
+    CHI##_k(E, B0, B1, B2, B3, B4) \
+    B0 = rol64(A##bu ^ Du, 27); \
+    B1 = rol64(A##ga ^ Da, 36); \
+    B2 = rol64(A##ke ^ De, 10); \
+    B3 = rol64(A##mi ^ Di, 15); \
+    B4 = rol64(A##so ^ Do, 56); \
+    CHI##_m(E, B0, B1, B2, B3, B4) \
+    B0 = rol64(A##bi ^ Di, 62); \
+    B1 = rol64(A##go ^ Do, 55); \
+    B2 = rol64(A##ku ^ Du, 39); \
+    B3 = rol64(A##ma ^ Da, 41); \
+    B4 = rol64(A##se ^ De, 2); \
+    CHI##_s(E, B0, B1, B2, B3, B4) \
+  }
+
+#define KECCAK_LOAD(state) \
+  uint64_t Aba, Abe, Abi, Abo, Abu, Aga, Age, Agi, Ago, Agu, Aka, Ake, Aki, Ako, Aku, Ama, Ame, \
+    Ami, Amo, Amu, Asa, Ase, Asi, Aso, Asu; \
+  uint64_t Eba, Ebe, Ebi, Ebo, Ebu, Ega, Ege, Egi, Ego, Egu, Eka, Eke, Eki, Eko, Eku, Ema, Eme, \
+    Emi, Emo, Emu, Esa, Ese, Esi, Eso, Esu; \
+  Aba = state[0]; \
+  Abe = state[1]; \
+  Abi = state[2]; \
+  Abo = state[3]; \
+  Abu = state[4]; \
+  Aga = state[5]; \
+  Age = state[6]; \
+  Agi = state[7]; \
+  Ago = state[8]; \
+  Agu = state[9]; \
+  Aka = state[10]; \
+  Ake = state[11]; \
+  Aki = state[12]; \
+  Ako = state[13]; \
+  Aku = state[14]; \
+  Ama = state[15]; \
+  Ame = state[16]; \
+  Ami = state[17]; \
+  Amo = state[18]; \
+  Amu = state[19]; \
+  Asa = state[20]; \
+  Ase = state[21]; \
+  Asi = state[22]; \
+  Aso = state[23]; \
+  Asu = state[24];
+
+#define KECCAK_STORE(state) \
+  state[0] = Aba; \
+  state[1] = Abe; \
+  state[2] = Abi; \
+  state[3] = Abo; \
+  state[4] = Abu; \
+  state[5] = Aga; \
+  state[6] = Age; \
+  state[7] = Agi; \
+  state[8] = Ago; \
+  state[9] = Agu; \
+  state[10] = Aka; \
+  state[11] = Ake; \
+  state[12] = Aki; \
+  state[13] = Ako; \
+  state[14] = Aku; \
+  state[15] = Ama; \
+  state[16] = Ame; \
+  state[17] = Ami; \
+  state[18] = Amo; \
+  state[19] = Amu; \
+  state[20] = Asa; \
+  state[21] = Ase; \
+  state[22] = Asi; \
+  state[23] = Aso; \
+  state[24] = Asu;
+
+#define KECCAK_ROUNDS_0_11(CHI) \
+  KECCAK_ROUND(A, E, 0, CHI) \
+  KECCAK_ROUND(E, A, 1, CHI) \
+  KECCAK_ROUND(A, E, 2, CHI) \
+  KECCAK_ROUND(E, A, 3, CHI) \
+  KECCAK_ROUND(A, E, 4, CHI) \
+  KECCAK_ROUND(E, A, 5, CHI) \
+  KECCAK_ROUND(A, E, 6, CHI) \
+  KECCAK_ROUND(E, A, 7, CHI) \
+  KECCAK_ROUND(A, E, 8, CHI) \
+  KECCAK_ROUND(E, A, 9, CHI) \
+  KECCAK_ROUND(A, E, 10, CHI) \
+  KECCAK_ROUND(E, A, 11, CHI)
+
+#define KECCAK_ROUNDS_12_23(CHI) \
+  KECCAK_ROUND(A, E, 12, CHI) \
+  KECCAK_ROUND(E, A, 13, CHI) \
+  KECCAK_ROUND(A, E, 14, CHI) \
+  KECCAK_ROUND(E, A, 15, CHI) \
+  KECCAK_ROUND(A, E, 16, CHI) \
+  KECCAK_ROUND(E, A, 17, CHI) \
+  KECCAK_ROUND(A, E, 18, CHI) \
+  KECCAK_ROUND(E, A, 19, CHI) \
+  KECCAK_ROUND(A, E, 20, CHI) \
+  KECCAK_ROUND(E, A, 21, CHI) \
+  KECCAK_ROUND(A, E, 22, CHI) \
+  KECCAK_ROUND(E, A, 23, CHI)
+
+// Keccak-f[1600]
+#define KECCAK_PERMUTATION(CHI) \
+  KECCAK_LOAD(state) \
+  KECCAK_ROUNDS_0_11(CHI) \
+  KECCAK_ROUNDS_12_23(CHI) \
+  KECCAK_STORE(state)
+
+// Keccak-p[1600, 12]
+#define KECCAK_PERMUTATION_12(CHI) \
+  KECCAK_LOAD(state) \
+  KECCAK_ROUNDS_12_23(CHI) \
+  KECCAK_STORE(state)
+
+// Lanes kept inverted by lane complementing variant
+#define KECCAK_COMPLEMENT(state) \
+  state[1] = ~state[1]; \
+  state[2] = ~state[2]; \
+  state[8] = ~state[8]; \
+  state[12] = ~state[12]; \
+  state[17] = ~state[17]; \
+  state[20] = ~state[20];
+
+static void sha3llTransformComplement(uint64_t state[25])
+{
+  KECCAK_COMPLEMENT(state)
+  KECCAK_PERMUTATION(CHI_COMPLEMENT)
+  KECCAK_COMPLEMENT(state)
+}
+
+static void sha3llTransform12Complement(uint64_t state[25])
+{
+  KECCAK_COMPLEMENT(state)
+  KECCAK_PERMUTATION_12(CHI_COMPLEMENT)
+  KECCAK_COMPLEMENT(state)
+}
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+// BIC instruction: plain chi is the best
 void sha3llTransform(uint64_t state[25])
 {
-  for (unsigned i = 0; i < 24; i++)
-    sha3llRound1600(state, i);
+  KECCAK_PERMUTATION(CHI_PLAIN)
+}
+
+void sha3llTransform12(uint64_t state[25])
+{
+  KECCAK_PERMUTATION_12(CHI_PLAIN)
+}
+#elif (defined(__x86_64__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__))
+// Plain chi compiled to ANDN if CPU supports BMI1, lane complementing otherwise
+__attribute__((target("bmi"))) static void sha3llTransformBmi(uint64_t state[25])
+{
+  KECCAK_PERMUTATION(CHI_PLAIN)
+}
+
+__attribute__((target("bmi"))) static void sha3llTransform12Bmi(uint64_t state[25])
+{
+  KECCAK_PERMUTATION_12(CHI_PLAIN)
+}
+
+static int bmiSupported(void)
+{
+  // Detected once, atomic access; same value written by all threads
+  static int cached = -1;
+  int supported = __atomic_load_n(&cached, __ATOMIC_RELAXED);
+  if (supported < 0) {
+    supported = __builtin_cpu_supports("bmi") != 0;
+    __atomic_store_n(&cached, supported, __ATOMIC_RELAXED);
+  }
+  return supported;
+}
+
+void sha3llTransform(uint64_t state[25])
+{
+  if (bmiSupported())
+    sha3llTransformBmi(state);
+  else
+    sha3llTransformComplement(state);
+}
+
+void sha3llTransform12(uint64_t state[25])
+{
+  if (bmiSupported())
+    sha3llTransform12Bmi(state);
+  else
+    sha3llTransform12Complement(state);
+}
+#else
+void sha3llTransform(uint64_t state[25])
+{
+  sha3llTransformComplement(state);
+}
+
+void sha3llTransform12(uint64_t state[25])
+{
+  sha3llTransform12Complement(state);
 }
+#endif
 
 void sha3Init(CCtxSha3 *ctx, unsigned hashSize)
 {
@@ -7,9 +7,13 @@ extern "C" {
 #endif
 
 // Low level
+// Iota step constants of Keccak-f[1600] rounds
+extern const uint64_t sha3llRoundConstants1600[24];
 void sha3llRound800(uint32_t state[25], unsigned round);
 void sha3llRound1600(uint64_t state[25], unsigned round);
 void sha3llTransform(uint64_t state[25]);
+// Keccak-p[1600, 12]: last 12 rounds of Keccak-f[1600], used by KangarooTwelve
+void sha3llTransform12(uint64_t state[25]);
 
 // High level
 typedef struct CCtxSha3 {
@@ -24,6 +28,29 @@ void sha3Update(CCtxSha3 *ctx, const void *data, size_t size);
 void sha3Final(CCtxSha3 *ctx, uint8_t *hash, int isKeccak);
 void sha3(const void *data, size_t size, uint8_t *hash, unsigned hashSize, int isKeccak);
 
+// Multi-buffer: 4 independent states processed at once, AVX2 used if supported by CPU
+typedef struct CCtxSha3x4 {
+  // Interleaved: word i of lane l is State[i*4 + l]
+  uint64_t State[100];
+  uint32_t HashSize;
+  uint32_t BlockSize;
+} CCtxSha3x4;
+
+// Returns non-zero if multi-buffer transform is faster than 4 single transforms
+int sha3x4Accelerated(void);
+void sha3llTransformX4(uint64_t state[100]);
+
+void sha3x4Init(CCtxSha3x4 *ctx, unsigned hashSize);
+void sha3x4InitLane(CCtxSha3x4 *ctx, unsigned lane);
+// Absorb 'blocks' full blocks into each lane; data of unused lane can be null, its state becomes undefined
+void sha3x4Update(CCtxSha3x4 *ctx, const uint8_t *const data[4], size_t blocks);
+// Hash of lane after padded last block (see sha3PadBlock) absorbed
+void sha3x4Digest(const CCtxSha3x4 *ctx, unsigned lane, uint8_t *hash);
+// Continue hashing of lane with single-buffer functions
+void sha3x4ExtractLane(const CCtxSha3x4 *ctx, unsigned lane, CCtxSha3 *out);
+// Turn last 'size' bytes of message into full padded block
+void sha3PadBlock(uint8_t *block, size_t size, unsigned blockSize, int isKeccak);
+
 #ifdef __cplusplus
 }
 #endif
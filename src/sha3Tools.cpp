@@ -3,35 +3,219 @@ extern "C" {
 #include "sha3.h"
 #include "base64.h"
 }
+#include "hashcache.h"
+#include "mappedfile.h"
+#include "parallel.h"
 #include "strExtras.h"
-#include <map>
+#include <string.h>
+#include <algorithm>
+#include <thread>
 
-std::string sha3FileHash(const std::filesystem::path &path)
+// Files up to this size read to thread local buffer, larger files are memory mapped
+static constexpr size_t MapThreshold = 1u << 20;
+static constexpr size_t ReadBufferSize = 1u << 20;
+static constexpr size_t BatchLaneBufferSize = 1u << 16;
+
+// Buffers reused by all hash calls of thread
+struct CHashBuffers {
+  std::unique_ptr<uint8_t[]> Read;
+  std::unique_ptr<uint8_t[]> Lanes;
+};
+
+static thread_local CHashBuffers threadBuffers;
+
+static uint8_t *threadReadBuffer()
+{
+  if (!threadBuffers.Read)
+    threadBuffers.Read.reset(new uint8_t[ReadBufferSize]);
+  return threadBuffers.Read.get();
+}
+
+static uint8_t *threadLaneBuffer(unsigned lane)
 {
+  if (!threadBuffers.Lanes)
+    threadBuffers.Lanes.reset(new uint8_t[4 * BatchLaneBufferSize]);
+  return threadBuffers.Lanes.get() + lane * BatchLaneBufferSize;
+}
+
+static bool sha3StreamDigest(InputFile &file, CCtxSha3 &ctx)
+{
+  uint8_t *buffer = threadReadBuffer();
+  size_t bytesRead = 0;
+  do {
+    if (!file.read(buffer, ReadBufferSize, &bytesRead))
+      return false;
+    sha3Update(&ctx, buffer, bytesRead);
+  } while (bytesRead);
+  return true;
+}
+
+bool sha3FileDigest(const std::filesystem::path &path, uint8_t digest[32])
+{
+  InputFile file;
+  if (!file.open(path))
+    return false;
+
   CCtxSha3 ctx;
   sha3Init(&ctx, 32);
+  if (file.size() > MapThreshold) {
+    MappedFile mapped;
+    if (mapped.open(path)) {
+      file.close();
+      mapped.adviseSequential();
+      sha3Update(&ctx, mapped.data(), mapped.size());
+      sha3Final(&ctx, digest, 0);
+      return true;
+    }
+  }
+
+  // Small file or mapping not possible
+  if (!sha3StreamDigest(file, ctx))
+    return false;
+  sha3Final(&ctx, digest, 0);
+  return true;
+}
+
+struct CBatchLane {
+  InputFile File;
+  size_t Index = 0;
+  uint8_t *Buffer = nullptr;
+  size_t Size = 0;
+  size_t Offset = 0;
+  bool Eof = false;
+  // Padded last block is in buffer
+  bool Final = false;
+};
 
-  static constexpr unsigned bufferSize = 1u << 22;
-  std::unique_ptr<uint8_t[]> buffer(new uint8_t[bufferSize]);
-  FILE *hFile = fopen(path.string().c_str(), "rb");
-  bool success = false;
-  if (hFile) {
+// Read more data, at least one block or padded last block will be available
+static bool batchLaneFill(CBatchLane &lane, unsigned blockSize)
+{
+  memmove(lane.Buffer, lane.Buffer + lane.Offset, lane.Size - lane.Offset);
+  lane.Size -= lane.Offset;
+  lane.Offset = 0;
+  if (!lane.Eof) {
     size_t bytesRead = 0;
-    while ( (bytesRead = fread(buffer.get(), 1, bufferSize, hFile)) )
-      sha3Update(&ctx, buffer.get(), bytesRead);
-    fclose(hFile);
-    success = true;
+    if (!lane.File.readFull(lane.Buffer + lane.Size, BatchLaneBufferSize - lane.Size, &bytesRead))
+      return false;
+    lane.Size += bytesRead;
+    lane.Eof = lane.Size < BatchLaneBufferSize;
   }
 
-  if (success) {
+  if (lane.Eof && lane.Size < blockSize) {
+    sha3PadBlock(lane.Buffer, lane.Size, blockSize, 0);
+    lane.Size = blockSize;
+    lane.Final = true;
+  }
+  return true;
+}
+
+// Last file of batch: no reason to process 4 lanes
+static bool batchLaneFinish(CBatchLane &lane, const CCtxSha3x4 &ctx, unsigned laneIndex, uint8_t digest[32])
+{
+  CCtxSha3 single;
+  sha3x4ExtractLane(&ctx, laneIndex, &single);
+  sha3Update(&single, lane.Buffer + lane.Offset, lane.Size - lane.Offset);
+  if (!lane.Eof && !sha3StreamDigest(lane.File, single))
+    return false;
+  sha3Final(&single, digest, 0);
+  return true;
+}
+
+void sha3FileDigestBatch(const std::vector<std::filesystem::path> &paths, std::vector<CFileDigest> &digests)
+{
+  digests.assign(paths.size(), CFileDigest());
+  if (paths.size() < 2 || !sha3x4Accelerated()) {
+    for (size_t i = 0; i < paths.size(); i++)
+      digests[i].Ok = sha3FileDigest(paths[i], digests[i].Digest);
+    return;
+  }
+
+  CCtxSha3x4 ctx;
+  sha3x4Init(&ctx, 32);
+  CBatchLane lanes[4];
+  for (unsigned i = 0; i < 4; i++)
+    lanes[i].Buffer = threadLaneBuffer(i);
+  size_t next = 0;
+
+  auto startLane = [&](CBatchLane &lane, unsigned laneIndex) {
+    while (next < paths.size()) {
+      size_t index = next++;
+      if (!lane.File.open(paths[index]))
+        continue;
+      // Large file: mapped and hashed alone
+      if (lane.File.size() > MapThreshold) {
+        lane.File.close();
+        digests[index].Ok = sha3FileDigest(paths[index], digests[index].Digest);
+        continue;
+      }
+      lane.Index = index;
+      lane.Size = lane.Offset = 0;
+      lane.Eof = lane.Final = false;
+      sha3x4InitLane(&ctx, laneIndex);
+      if (batchLaneFill(lane, ctx.BlockSize))
+        return;
+      lane.File.close();
+    }
+  };
+
+  for (;;) {
+    unsigned active = 0;
+    for (unsigned i = 0; i < 4; i++) {
+      if (!lanes[i].File.isOpen())
+        startLane(lanes[i], i);
+      active += lanes[i].File.isOpen();
+    }
+    if (active == 0)
+      break;
+
+    if (active == 1 && next == paths.size()) {
+      for (unsigned i = 0; i < 4; i++) {
+        if (lanes[i].File.isOpen() && !lanes[i].Final) {
+          digests[lanes[i].Index].Ok = batchLaneFinish(lanes[i], ctx, i, digests[lanes[i].Index].Digest);
+          lanes[i].File.close();
+        }
+      }
+      if (std::none_of(std::begin(lanes), std::end(lanes), [](const CBatchLane &lane) { return lane.File.isOpen(); }))
+        break;
+    }
+
+    // Lanes absorb same number of blocks
+    size_t blocks = SIZE_MAX;
+    const uint8_t *data[4] = {nullptr, nullptr, nullptr, nullptr};
+    for (unsigned i = 0; i < 4; i++) {
+      if (lanes[i].File.isOpen()) {
+        blocks = std::min(blocks, (lanes[i].Size - lanes[i].Offset) / ctx.BlockSize);
+        data[i] = lanes[i].Buffer + lanes[i].Offset;
+      }
+    }
+    sha3x4Update(&ctx, data, blocks);
+
+    for (unsigned i = 0; i < 4; i++) {
+      CBatchLane &lane = lanes[i];
+      if (!lane.File.isOpen())
+        continue;
+      lane.Offset += blocks * ctx.BlockSize;
+      if (lane.Final && lane.Offset == lane.Size) {
+        sha3x4Digest(&ctx, i, digests[lane.Index].Digest);
+        digests[lane.Index].Ok = true;
+        lane.File.close();
+      } else if (lane.Size - lane.Offset < ctx.BlockSize && !batchLaneFill(lane, ctx.BlockSize)) {
+        lane.File.close();
+      }
+    }
+  }
+}
+
+std::string sha3FileHash(const std::filesystem::path &path)
+{
+  return hashCacheFileHash(path, "sha3", [](const std::filesystem::path &path) -> std::string {
     uint8_t hash[32];
     char hex[72] = {0};
-    sha3Final(&ctx, hash, 0);
+    if (!sha3FileDigest(path, hash))
+      return std::string();
     bin2hexLowerCase(hash, hex, 32);
     return hex;
-  } else {
-    return std::string();
-  }
+  });
 }
 
 std::string sha3StringHash(const std::string &s)
@@ -73,31 +257,82 @@ std::string sha3StringHashBase64url(const std::string &s, size_t bytes)
   return result;
 }
 
-static std::string sha3Hash(const std::filesystem::path &path, const std::string &excludeFile)
-{
-  if (std::filesystem::is_directory(path))
-    return sha3DirectoryHash(path, excludeFile);
-  else
-    return sha3FileHash(path);
-}
+// Directory tree flattened in breadth-first order: children of node are contiguous and sorted by name,
+// indices of children are greater than index of parent
+struct CDirectoryHashNode {
+  std::filesystem::path Path;
+  std::string Name;
+  bool IsDirectory = false;
+  size_t FirstChild = 0;
+  size_t ChildrenNum = 0;
+  uint8_t Digest[32];
+};
 
-std::string sha3DirectoryHash(const std::filesystem::path &dir, const std::string &excludeFile)
-{
-  std::map<std::string, std::string> entries;
+static constexpr size_t DirectoryHashBatchFiles = 16;
 
-  for (const auto &entry : std::filesystem::directory_iterator(dir)) {
-    std::string name = entry.path().filename().string();
-    if (!excludeFile.empty() && name == excludeFile)
+std::string sha3DirectoryHash(const std::filesystem::path &dir, const std::string &excludeFile, unsigned threads)
+{
+  std::vector<CDirectoryHashNode> nodes(1);
+  std::vector<size_t> files;
+  nodes[0].Path = dir;
+  nodes[0].IsDirectory = true;
+  for (size_t i = 0; i < nodes.size(); i++) {
+    if (!nodes[i].IsDirectory) {
+      files.push_back(i);
       continue;
-    std::string hash = sha3Hash(entry.path(), excludeFile);
-    if (hash.empty())
-      return std::string();
-    entries[name] = hash;
+    }
+
+    size_t first = nodes.size();
+    for (const auto &entry : std::filesystem::directory_iterator(nodes[i].Path)) {
+      std::string name = entry.path().filename().string();
+      if (!excludeFile.empty() && name == excludeFile)
+        continue;
+      CDirectoryHashNode &node = nodes.emplace_back();
+      node.Path = entry.path();
+      node.Name = std::move(name);
+      node.IsDirectory = std::filesystem::is_directory(node.Path);
+    }
+    std::sort(nodes.begin() + first, nodes.end(), [](const CDirectoryHashNode &l, const CDirectoryHashNode &r) { return l.Name < r.Name; });
+    nodes[i].FirstChild = first;
+    nodes[i].ChildrenNum = nodes.size() - first;
   }
 
-  std::string concatenated;
-  for (const auto &[name, hash] : entries)
-    concatenated += hash;
+  // Files of all subdirectories hashed in parallel, by multi-buffer sha3 inside batch
+  size_t batchesNum = (files.size() + DirectoryHashBatchFiles - 1) / DirectoryHashBatchFiles;
+  bool success = parallelFor(batchesNum, std::max(threads, 1u), [&](size_t batch) -> bool {
+    size_t begin = batch * DirectoryHashBatchFiles;
+    size_t end = std::min(begin + DirectoryHashBatchFiles, files.size());
+    std::vector<std::filesystem::path> paths;
+    std::vector<CFileDigest> digests;
+    for (size_t i = begin; i < end; i++)
+      paths.push_back(nodes[files[i]].Path);
+    sha3FileDigestBatch(paths, digests);
+    for (size_t i = begin; i < end; i++) {
+      if (!digests[i - begin].Ok)
+        return false;
+      memcpy(nodes[files[i]].Digest, digests[i - begin].Digest, 32);
+    }
+    return true;
+  });
+  if (!success)
+    return std::string();
+
+  // Directory digest is SHA3 of concatenated hex digests of children
+  for (size_t i = nodes.size(); i-- > 0;) {
+    CDirectoryHashNode &node = nodes[i];
+    if (!node.IsDirectory)
+      continue;
+    CCtxSha3 ctx;
+    sha3Init(&ctx, 32);
+    for (size_t child = node.FirstChild; child < node.FirstChild + node.ChildrenNum; child++) {
+      char hex[72] = {0};
+      bin2hexLowerCase(nodes[child].Digest, hex, 32);
+      sha3Update(&ctx, hex, 64);
+    }
+    sha3Final(&ctx, node.Digest, 0);
+  }
 
-  return sha3StringHash(concatenated);
+  char hex[72] = {0};
+  bin2hexLowerCase(nodes[0].Digest, hex, 32);
+  return hex;
 }
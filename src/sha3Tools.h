@@ -1,9 +1,20 @@
 #pragma once
 
+#include <stdint.h>
 #include <filesystem>
 #include <string>
+#include <vector>
 
+struct CFileDigest {
+  uint8_t Digest[32];
+  bool Ok = false;
+};
+
+bool sha3FileDigest(const std::filesystem::path &path, uint8_t digest[32]);
+// Hash several files by one thread, multi-buffer sha3 used if accelerated; Ok is false for unreadable files
+void sha3FileDigestBatch(const std::vector<std::filesystem::path> &paths, std::vector<CFileDigest> &digests);
 std::string sha3FileHash(const std::filesystem::path &path);
 std::string sha3StringHash(const std::string &s);
 std::string sha3StringHashBase64url(const std::string &s, size_t bytes);
-std::string sha3DirectoryHash(const std::filesystem::path &dir, const std::string &excludeFile = "");
+// Files hashed by 'threads' threads
+std::string sha3DirectoryHash(const std::filesystem::path &dir, const std::string &excludeFile, unsigned threads);
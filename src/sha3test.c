@@ -0,0 +1,107 @@
+// Unrolled Keccak-f[1600] permutations against reference sha3llRound1600, with throughput report
+// Includes sha3.c directly to reach implementation variants not exported by sha3.h
+
+#include "sha3.c"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+typedef void CTransformFn(uint64_t state[25]);
+
+typedef struct CTransformVariant {
+  const char *Name;
+  CTransformFn *Transform;
+  unsigned FirstRound;
+} CTransformVariant;
+
+static uint64_t randomState = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t random64(void)
+{
+  // xorshift64*
+  randomState ^= randomState >> 12;
+  randomState ^= randomState << 25;
+  randomState ^= randomState >> 27;
+  return randomState * 0x2545f4914f6cdd1dULL;
+}
+
+static void referenceTransform(uint64_t state[25], unsigned firstRound)
+{
+  for (unsigned round = firstRound; round < 24; round++)
+    sha3llRound1600(state, round);
+}
+
+static int checkVariant(const CTransformVariant *variant, unsigned iterations)
+{
+  for (unsigned i = 0; i < iterations; i++) {
+    uint64_t expected[25];
+    uint64_t actual[25];
+    for (unsigned j = 0; j < 25; j++)
+      expected[j] = random64();
+    memcpy(actual, expected, sizeof(actual));
+    referenceTransform(expected, variant->FirstRound);
+    variant->Transform(actual);
+    if (memcmp(expected, actual, sizeof(actual)) != 0) {
+      fprintf(stderr, "ERROR: %s differs from reference at iteration %u\n", variant->Name, i);
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+static void benchmarkVariant(const CTransformVariant *variant, unsigned iterations)
+{
+  uint64_t state[25];
+  for (unsigned j = 0; j < 25; j++)
+    state[j] = random64();
+
+  clock_t begin = clock();
+  for (unsigned i = 0; i < iterations; i++)
+    variant->Transform(state);
+  double seconds = (double)(clock() - begin) / CLOCKS_PER_SEC;
+  if (seconds <= 0.0)
+    seconds = 1.0 / CLOCKS_PER_SEC;
+
+  // Rate of SHA3-256 (136 bytes per permutation), state word printed to keep loop alive
+  printf("%-24s %10.1f ns/permutation %8.1f MiB/s (%016llx)\n",
+         variant->Name,
+         seconds * 1e9 / iterations,
+         136.0 * iterations / seconds / (1024.0 * 1024.0),
+         (unsigned long long)state[0]);
+}
+
+static void referenceTransform24(uint64_t state[25])
+{
+  referenceTransform(state, 0);
+}
+
+int sha3TestPermutations(unsigned benchmarkIterations)
+{
+  CTransformVariant variants[8];
+  unsigned variantsNum = 0;
+
+  variants[variantsNum++] = (CTransformVariant){"reference", referenceTransform24, 0};
+  variants[variantsNum++] = (CTransformVariant){"sha3llTransform", sha3llTransform, 0};
+  variants[variantsNum++] = (CTransformVariant){"sha3llTransform12", sha3llTransform12, 12};
+  variants[variantsNum++] = (CTransformVariant){"complement", sha3llTransformComplement, 0};
+  variants[variantsNum++] = (CTransformVariant){"complement12", sha3llTransform12Complement, 12};
+#if (defined(__x86_64__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__))
+  if (bmiSupported()) {
+    variants[variantsNum++] = (CTransformVariant){"bmi", sha3llTransformBmi, 0};
+    variants[variantsNum++] = (CTransformVariant){"bmi12", sha3llTransform12Bmi, 12};
+  } else {
+    printf("BMI not supported by CPU, BMI variants skipped\n");
+  }
+#endif
+
+  for (unsigned i = 1; i < variantsNum; i++) {
+    if (!checkVariant(&variants[i], 10000))
+      return 0;
+  }
+  printf("All permutation variants match reference\n");
+
+  for (unsigned i = 0; i < variantsNum; i++)
+    benchmarkVariant(&variants[i], benchmarkIterations);
+  return 1;
+}
@@ -0,0 +1,282 @@
+// Hash implementations against references: permutations (sha3test.c), multi-buffer SHA3 lanes against single
+// buffer SHA3, KangarooTwelve against RFC 9861 test vectors, streaming and file hashing against one-shot KT128
+
+extern "C" {
+#include "sha3.h"
+#include "k12.h"
+int sha3TestPermutations(unsigned benchmarkIterations);
+}
+#include "k12Tools.h"
+#include "sha3Tools.h"
+#include "strExtras.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+static std::mt19937_64 gRandom(12345);
+
+static std::vector<uint8_t> randomBytes(size_t size)
+{
+  std::vector<uint8_t> data(size);
+  for (auto &byte: data)
+    byte = static_cast<uint8_t>(gRandom());
+  return data;
+}
+
+static std::string hex(const uint8_t *data, size_t size)
+{
+  std::string result(size * 2, '\0');
+  bin2hexLowerCase(data, result.data(), size);
+  return result;
+}
+
+static bool writeFile(const std::filesystem::path &path, const std::vector<uint8_t> &data)
+{
+  std::ofstream file(path, std::ios::binary);
+  file.write(reinterpret_cast<const char*>(data.data()), data.size());
+  return static_cast<bool>(file);
+}
+
+// Lanes with different message lengths; lane refilled with next message when its message finished
+static bool checkSha3x4Lanes()
+{
+  static const size_t lengths[] = {0, 1, 135, 136, 137, 271, 272, 1000, 4096, 7, 20000, 65, 3000, 136 * 5};
+  static const size_t messagesNum = sizeof(lengths) / sizeof(lengths[0]);
+  std::vector<std::vector<uint8_t>> messages;
+  std::vector<std::vector<uint8_t>> expected;
+  for (size_t length: lengths) {
+    messages.push_back(randomBytes(length));
+    expected.emplace_back(32);
+    sha3(messages.back().data(), length, expected.back().data(), 32, 0);
+  }
+
+  CCtxSha3x4 ctx;
+  sha3x4Init(&ctx, 32);
+  unsigned blockSize = ctx.BlockSize;
+
+  struct CLane {
+    size_t Message = SIZE_MAX;
+    // Message with padding
+    std::vector<uint8_t> Padded;
+    size_t Offset = 0;
+  } lanes[4];
+
+  size_t next = 0;
+  size_t finished = 0;
+  for (;;) {
+    for (unsigned i = 0; i < 4; i++) {
+      if (lanes[i].Message == SIZE_MAX && next < messagesNum) {
+        CLane &lane = lanes[i];
+        lane.Message = next++;
+        const std::vector<uint8_t> &message = messages[lane.Message];
+        size_t fullBlocks = message.size() / blockSize;
+        lane.Padded.assign(message.begin(), message.end());
+        lane.Padded.resize((fullBlocks + 1) * blockSize);
+        sha3PadBlock(lane.Padded.data() + fullBlocks * blockSize, message.size() % blockSize, blockSize, 0);
+        lane.Offset = 0;
+        sha3x4InitLane(&ctx, i);
+      }
+    }
+
+    size_t blocks = SIZE_MAX;
+    const uint8_t *data[4] = {nullptr, nullptr, nullptr, nullptr};
+    for (unsigned i = 0; i < 4; i++) {
+      if (lanes[i].Message != SIZE_MAX) {
+        blocks = std::min(blocks, (lanes[i].Padded.size() - lanes[i].Offset) / blockSize);
+        data[i] = lanes[i].Padded.data() + lanes[i].Offset;
+      }
+    }
+    if (blocks == SIZE_MAX)
+      break;
+
+    sha3x4Update(&ctx, data, blocks);
+    for (unsigned i = 0; i < 4; i++) {
+      CLane &lane = lanes[i];
+      if (lane.Message == SIZE_MAX)
+        continue;
+      lane.Offset += blocks * blockSize;
+      if (lane.Offset == lane.Padded.size()) {
+        uint8_t digest[32];
+        sha3x4Digest(&ctx, i, digest);
+        if (memcmp(digest, expected[lane.Message].data(), 32) != 0) {
+          fprintf(stderr, "ERROR: sha3x4 lane %u differs from sha3 for %zu bytes message\n", i, messages[lane.Message].size());
+          return false;
+        }
+        lane.Message = SIZE_MAX;
+        finished++;
+      }
+    }
+  }
+
+  if (finished != messagesNum) {
+    fprintf(stderr, "ERROR: sha3x4 finished %zu messages of %zu\n", finished, messagesNum);
+    return false;
+  }
+
+  printf("sha3x4 lanes match sha3 (%s)\n", sha3x4Accelerated() ? "accelerated" : "generic");
+  return true;
+}
+
+// Batch of files with unequal sizes: lanes refilled, large file hashed alone, last file finished by single lane
+static bool checkSha3FileBatch(const std::filesystem::path &dir)
+{
+  static const size_t sizes[] = {0, 1, 136, 137, 65535, 65536, 65537, 200000, 3, (1u << 20) + 17, 999, 136 * 481, 5};
+  std::vector<std::filesystem::path> paths;
+  std::vector<std::vector<uint8_t>> expected;
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    std::vector<uint8_t> data = randomBytes(sizes[i]);
+    paths.push_back(dir / ("batch" + std::to_string(i)));
+    if (!writeFile(paths.back(), data)) {
+      fprintf(stderr, "ERROR: can't write %s\n", paths.back().string().c_str());
+      return false;
+    }
+    expected.emplace_back(32);
+    sha3(data.data(), data.size(), expected.back().data(), 32, 0);
+  }
+  paths.push_back(dir / "not-exists");
+
+  // Every prefix of list: batch ends in different lane states
+  for (size_t count = 1; count <= paths.size(); count++) {
+    std::vector<std::filesystem::path> batch(paths.begin(), paths.begin() + count);
+    std::vector<CFileDigest> digests;
+    sha3FileDigestBatch(batch, digests);
+    for (size_t i = 0; i < count; i++) {
+      bool exists = i < expected.size();
+      uint8_t single[32];
+      bool singleOk = sha3FileDigest(batch[i], single);
+      if (digests[i].Ok != exists || singleOk != exists ||
+          (exists && (memcmp(digests[i].Digest, expected[i].data(), 32) != 0 || memcmp(single, expected[i].data(), 32) != 0))) {
+        fprintf(stderr, "ERROR: sha3FileDigestBatch differs from sha3FileDigest for %s (batch of %zu)\n", batch[i].string().c_str(), count);
+        return false;
+      }
+    }
+  }
+
+  printf("sha3FileDigestBatch matches sha3FileDigest\n");
+  return true;
+}
+
+// RFC 9861 pattern: 00 01 .. FA repeated
+static std::vector<uint8_t> ptn(size_t size)
+{
+  std::vector<uint8_t> data(size);
+  for (size_t i = 0; i < size; i++)
+    data[i] = static_cast<uint8_t>(i % 251);
+  return data;
+}
+
+static bool checkK12Vectors()
+{
+  struct CVector {
+    std::vector<uint8_t> Message;
+    std::vector<uint8_t> Custom;
+    size_t OutputSize;
+    // Last 32 bytes of output are compared
+    const char *Expected;
+  };
+
+  size_t p17 = 1;
+  std::vector<CVector> vectors = {
+    {{}, {}, 32, "1ac2d450fc3b4205d19da7bfca1b37513c0803577ac7167f06fe2ce1f0ef39e5"},
+    {{}, {}, 64, "4269c056b8c82e48276038b6d292966cc07a3d4645272e31ff38508139eb0a71"},
+    {{}, {}, 10032, "e8dc563642f7228c84684c898405d3a834799158c079b12880277a1d28e2ff6d"},
+    {ptn(1), {}, 32, "2bda92450e8b147f8a7cb629e784a058efca7cf7d8218e02d345dfaa65244a1f"},
+    {ptn(p17 *= 17), {}, 32, "6bf75fa2239198db4772e36478f8e19b0f371205f6a9a93a273f51df37122888"},
+    {ptn(p17 *= 17), {}, 32, "0c315ebcdedbf61426de7dcf8fb725d1e74675d7f5327a5067f367b108ecb67c"},
+    {ptn(p17 *= 17), {}, 32, "cb552e2ec77d9910701d578b457ddf772c12e322e4ee7fe417f92c758f0d59d0"},
+    {ptn(p17 *= 17), {}, 32, "8701045e22205345ff4dda05555cbb5c3af1a771c2b89baef37db43d9998b9fe"},
+    {ptn(p17 *= 17), {}, 32, "844d610933b1b9963cbdeb5ae3b6b05cc7cbd67ceedf883eb678a0a8e0371682"},
+    {ptn(p17 *= 17), {}, 32, "3c390782a8a4e89fa6367f72feaaf13255c8d95878481d3cd8ce85f58e880af8"},
+    {{}, ptn(1), 32, "fab658db63e94a246188bf7af69a133045f46ee984c56e3c3328caaf1aa1a583"},
+    {{0xFF}, ptn(41), 32, "d848c5068ced736f4462159b9867fd4c20b808acc3d5bc48e0b06ba0a3762ec4"},
+    {{0xFF, 0xFF, 0xFF}, ptn(41 * 41), 32, "c389e5009ae57120854c2e8c64670ac01358cf4c1baf89447a724234dc7ced74"},
+    {std::vector<uint8_t>(7, 0xFF), ptn(41 * 41 * 41), 32, "75d2f86a2e644566726b4fbcfc5657b9dbcf070c7b0dca06450ab291d7443bcf"},
+    {ptn(8191), {}, 32, "1b577636f723643e990cc7d6a659837436fd6a103626600eb8301cd1dbe553d6"},
+    {ptn(8192), {}, 32, "48f256f6772f9edfb6a8b661ec92dc93b95ebd05a08a17b39ae3490870c926c3"},
+    {ptn(8192), ptn(8189), 32, "3ed12f70fb05ddb58689510ab3e4d23c6c6033849aa01e1d8c220a297fedcd0b"},
+    {ptn(8192), ptn(8190), 32, "6a7c1b6a5cd0d8c9ca943a4a216cc64604559a2ea45f78570a15253d67ba00ae"}
+  };
+
+  for (const auto &vector: vectors) {
+    std::vector<uint8_t> out(vector.OutputSize);
+    k12(vector.Message.data(), vector.Message.size(), vector.Custom.data(), vector.Custom.size(), out.data(), out.size());
+    std::string actual = hex(out.data() + out.size() - 32, 32);
+    if (actual != vector.Expected) {
+      fprintf(stderr, "ERROR: KT128(%zu bytes, custom %zu bytes, %zu) = %s, expected %s\n",
+              vector.Message.size(), vector.Custom.size(), vector.OutputSize, actual.c_str(), vector.Expected);
+      return false;
+    }
+  }
+
+  printf("KT128 matches RFC 9861 test vectors\n");
+  return true;
+}
+
+// Streaming with random piece sizes and parallel file hashing must give one-shot KT128 digest
+static bool checkK12StreamAndFile(const std::filesystem::path &dir)
+{
+  static const size_t sizes[] = {0, 1, 8191, 8192, 8193, 16383, 16384, 16385, 8192 * 3 + 5, 8192 * 64, 8192 * 65 + 1, (1u << 20) + 3};
+  for (size_t size: sizes) {
+    std::vector<uint8_t> data = randomBytes(size);
+    uint8_t expected[32];
+    k12(data.data(), data.size(), nullptr, 0, expected, 32);
+
+    CCtxK12 ctx;
+    k12StreamInit(&ctx);
+    for (size_t offset = 0; offset < size;) {
+      size_t piece = std::min<size_t>(size - offset, gRandom() % 20000);
+      k12StreamUpdate(&ctx, data.data() + offset, piece);
+      offset += piece;
+    }
+    uint8_t streamed[32];
+    k12StreamFinal(&ctx, streamed, 32);
+    if (memcmp(streamed, expected, 32) != 0) {
+      fprintf(stderr, "ERROR: k12Stream differs from k12 for %zu bytes\n", size);
+      return false;
+    }
+
+    std::filesystem::path path = dir / ("k12-" + std::to_string(size));
+    if (!writeFile(path, data)) {
+      fprintf(stderr, "ERROR: can't write %s\n", path.string().c_str());
+      return false;
+    }
+    for (unsigned threads: {1u, 4u}) {
+      uint8_t fileDigest[32];
+      if (!k12FileDigest(path, fileDigest, threads) || memcmp(fileDigest, expected, 32) != 0) {
+        fprintf(stderr, "ERROR: k12FileDigest (%u threads) differs from k12 for %zu bytes\n", threads, size);
+        return false;
+      }
+    }
+    if (k12FileHash(path, 2) != hex(expected, 32)) {
+      fprintf(stderr, "ERROR: k12FileHash differs from k12 for %zu bytes\n", size);
+      return false;
+    }
+  }
+
+  printf("KT128 streaming and file hashing match one-shot KT128\n");
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  unsigned benchmarkIterations = argc >= 2 ? static_cast<unsigned>(strtoul(argv[1], nullptr, 10)) : 1000000;
+
+  std::error_code ec;
+  std::filesystem::path dir = std::filesystem::temp_directory_path(ec) / ("cxx-pm-sha3test-" + std::to_string(std::random_device()()));
+  if (ec || !std::filesystem::create_directories(dir, ec)) {
+    fprintf(stderr, "ERROR: can't create temporary directory\n");
+    return 1;
+  }
+
+  bool success = checkSha3x4Lanes() &&
+                 checkSha3FileBatch(dir) &&
+                 checkK12Vectors() &&
+                 checkK12StreamAndFile(dir) &&
+                 sha3TestPermutations(benchmarkIterations);
+  std::filesystem::remove_all(dir, ec);
+  return success ? 0 : 1;
+}
@@ -0,0 +1,217 @@
+#include "sha3.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SHA3X4_AVX2
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SHA3X4_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SHA3X4_TARGET_AVX2
+#endif
+
+static void sha3llTransformX4Generic(uint64_t state[100])
+{
+  for (unsigned lane = 0; lane < 4; lane++) {
+    uint64_t laneState[25];
+    for (unsigned i = 0; i < 25; i++)
+      laneState[i] = state[i*4 + lane];
+    sha3llTransform(laneState);
+    for (unsigned i = 0; i < 25; i++)
+      state[i*4 + lane] = laneState[i];
+  }
+}
+
+#ifdef SHA3X4_AVX2
+
+#define ROL(x, n) _mm256_or_si256(_mm256_slli_epi64((x), (n)), _mm256_srli_epi64((x), 64 - (n)))
+#define XOR(a, b) _mm256_xor_si256((a), (b))
+// a ^ (~b & c)
+#define CHI(a, b, c) _mm256_xor_si256((a), _mm256_andnot_si256((b), (c)))
+
+SHA3X4_TARGET_AVX2 static void sha3llTransformX4Avx2(uint64_t state[100])
+{
+  __m256i s[25];
+  for (unsigned i = 0; i < 25; i++)
+    s[i] = _mm256_loadu_si256((const __m256i*)(state + i*4));
+
+  for (unsigned round = 0; round < 24; round++) {
+    // Theta
+    __m256i bc0 = XOR(XOR(XOR(s[0], s[5]), XOR(s[10], s[15])), s[20]);
+    __m256i bc1 = XOR(XOR(XOR(s[1], s[6]), XOR(s[11], s[16])), s[21]);
+    __m256i bc2 = XOR(XOR(XOR(s[2], s[7]), XOR(s[12], s[17])), s[22]);
+    __m256i bc3 = XOR(XOR(XOR(s[3], s[8]), XOR(s[13], s[18])), s[23]);
+    __m256i bc4 = XOR(XOR(XOR(s[4], s[9]), XOR(s[14], s[19])), s[24]);
+    __m256i v0 = XOR(bc4, ROL(bc1, 1));
+    __m256i v1 = XOR(bc0, ROL(bc2, 1));
+    __m256i v2 = XOR(bc1, ROL(bc3, 1));
+    __m256i v3 = XOR(bc2, ROL(bc4, 1));
+    __m256i v4 = XOR(bc3, ROL(bc0, 1));
+    for (unsigned i = 0; i < 25; i += 5) {
+      s[i] = XOR(s[i], v0);
+      s[i+1] = XOR(s[i+1], v1);
+      s[i+2] = XOR(s[i+2], v2);
+      s[i+3] = XOR(s[i+3], v3);
+      s[i+4] = XOR(s[i+4], v4);
+    }
+
+    // Rho Pi
+    __m256i s1 = s[1];
+    s[1] = ROL(s[6], 44);
+    s[6] = ROL(s[9], 20);
+    s[9] = ROL(s[22], 61);
+    s[22] = ROL(s[14], 39);
+    s[14] = ROL(s[20], 18);
+    s[20] = ROL(s[2], 62);
+    s[2] = ROL(s[12], 43);
+    s[12] = ROL(s[13], 25);
+    s[13] = ROL(s[19], 8);
+    s[19] = ROL(s[23], 56);
+    s[23] = ROL(s[15], 41);
+    s[15] = ROL(s[4], 27);
+    s[4] = ROL(s[24], 14);
+    s[24] = ROL(s[21], 2);
+    s[21] = ROL(s[8], 55);
+    s[8] = ROL(s[16], 45);
+    s[16] = ROL(s[5], 36);
+    s[5] = ROL(s[3], 28);
+    s[3] = ROL(s[18], 21);
+    s[18] = ROL(s[17], 15);
+    s[17] = ROL(s[11], 10);
+    s[11] = ROL(s[7], 6);
+    s[7] = ROL(s[10], 3);
+    s[10] = ROL(s1, 1);
+
+    // Chi
+    for (unsigned i = 0; i < 25; i += 5) {
+      __m256i v = s[i];
+      __m256i w = s[i+1];
+      s[i] = CHI(v, w, s[i+2]);
+      s[i+1] = CHI(w, s[i+2], s[i+3]);
+      s[i+2] = CHI(s[i+2], s[i+3], s[i+4]);
+      s[i+3] = CHI(s[i+3], s[i+4], v);
+      s[i+4] = CHI(s[i+4], v, w);
+    }
+
+    // Iota
+    s[0] = XOR(s[0], _mm256_set1_epi64x((long long)sha3llRoundConstants1600[round]));
+  }
+
+  for (unsigned i = 0; i < 25; i++)
+    _mm256_storeu_si256((__m256i*)(state + i*4), s[i]);
+}
+
+static int avx2Supported(void)
+{
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7)
+    return 0;
+  // OSXSAVE and AVX, then OS saves YMM registers
+  __cpuid(info, 1);
+  if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6)
+    return 0;
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+int sha3x4Accelerated(void)
+{
+#ifdef SHA3X4_AVX2
+  // Detected once, atomic access; same value written by all threads
+  static long cached = -1;
+#ifdef _MSC_VER
+  long supported = _InterlockedOr(&cached, 0);
+  if (supported < 0) {
+    supported = avx2Supported() != 0;
+    _InterlockedExchange(&cached, supported);
+  }
+#else
+  long supported = __atomic_load_n(&cached, __ATOMIC_RELAXED);
+  if (supported < 0) {
+    supported = avx2Supported() != 0;
+    __atomic_store_n(&cached, supported, __ATOMIC_RELAXED);
+  }
+#endif
+  return (int)supported;
+#else
+  return 0;
+#endif
+}
+
+void sha3llTransformX4(uint64_t state[100])
+{
+#ifdef SHA3X4_AVX2
+  if (sha3x4Accelerated()) {
+    sha3llTransformX4Avx2(state);
+    return;
+  }
+#endif
+  sha3llTransformX4Generic(state);
+}
+
+void sha3x4Init(CCtxSha3x4 *ctx, unsigned hashSize)
+{
+  ctx->HashSize = hashSize;
+  ctx->BlockSize = 200 - 2 * hashSize;
+  memset(ctx->State, 0, sizeof(ctx->State));
+}
+
+void sha3x4InitLane(CCtxSha3x4 *ctx, unsigned lane)
+{
+  for (unsigned i = 0; i < 25; i++)
+    ctx->State[i*4 + lane] = 0;
+}
+
+void sha3x4Update(CCtxSha3x4 *ctx, const uint8_t *const data[4], size_t blocks)
+{
+  unsigned words = ctx->BlockSize / 8;
+  for (size_t block = 0; block < blocks; block++) {
+    for (unsigned lane = 0; lane < 4; lane++) {
+      if (!data[lane])
+        continue;
+      const uint8_t *p = data[lane] + block * ctx->BlockSize;
+      for (unsigned i = 0; i < words; i++) {
+        uint64_t word;
+        memcpy(&word, p + i*8, sizeof(word));
+        ctx->State[i*4 + lane] ^= word;
+      }
+    }
+    sha3llTransformX4(ctx->State);
+  }
+}
+
+void sha3x4Digest(const CCtxSha3x4 *ctx, unsigned lane, uint8_t *hash)
+{
+  for (unsigned i = 0; i*8 < ctx->HashSize; i++) {
+    unsigned size = ctx->HashSize - i*8 < 8 ? ctx->HashSize - i*8 : 8;
+    memcpy(hash + i*8, &ctx->State[i*4 + lane], size);
+  }
+}
+
+void sha3x4ExtractLane(const CCtxSha3x4 *ctx, unsigned lane, CCtxSha3 *out)
+{
+  for (unsigned i = 0; i < 25; i++)
+    out->State[i] = ctx->State[i*4 + lane];
+  out->HashSize = ctx->HashSize;
+  out->BlockSize = ctx->BlockSize;
+  out->BufferSize = 0;
+}
+
+void sha3PadBlock(uint8_t *block, size_t size, unsigned blockSize, int isKeccak)
+{
+  memset(block + size, 0, blockSize - size);
+  block[size] ^= !isKeccak ? 0x06 : 0x01;
+  block[blockSize - 1] ^= 0x80;
+}